@@ -0,0 +1,236 @@
+#include "audio.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+The sound is the 1-bit audio pattern, played at the rate the pitch sets. Every change from one pattern sample to the
+next is a step, and a step sampled as it is aliases into a harsh buzz at most pitches. PolyBLEP rounds off the output
+sample on either side of every step with a polynomial, which takes out most of the aliasing for a few multiplications.
+
+The positions of the ring are free running counters, the index of a sample is its position masked by the ring size and
+the number of queued samples is write - read, which stays right when the counters wrap around. SDL_AtomicSet and
+SDL_AtomicGet are full barriers, so the samples are in the ring before the position that hands them over is.
+*/
+
+#define AUDIO_RING_MASK (AUDIO_RING_SIZE - 1)
+#define AUDIO_VOLUME 6000.0
+
+// Function prototypes
+void audio_callback(void* userdata, Uint8* stream, int length);
+double pattern_level(const Uint8* pattern, int sample);
+void reset_ring(Audio* audio);
+
+int open_audio(Audio* audio)
+{
+	memset(audio, 0, sizeof(Audio));
+
+	SDL_AudioSpec desired;
+	SDL_AudioSpec obtained;
+	SDL_zero(desired);
+	desired.freq = AUDIO_SAMPLE_RATE;
+	desired.format = AUDIO_S16SYS;
+	desired.channels = 1;
+	desired.samples = AUDIO_DEVICE_SAMPLES;
+	desired.callback = audio_callback;
+	desired.userdata = audio;
+
+	// SDL converts to whatever the device wants, the callback always gets the format above
+	audio->device = SDL_OpenAudioDevice(NULL, 0, &desired, &obtained, 0);
+	if (audio->device == 0)
+	{
+		printf("Audio could not be opened, running without sound! SDL_Error: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	// The device opens paused, it starts playing when the first frame is queued
+	reset_ring(audio);
+	audio->paused = 1;
+
+	return 0;
+}
+
+void close_audio(Audio* audio)
+{
+	if (audio->device != 0)
+		SDL_CloseAudioDevice(audio->device);
+
+	audio->device = 0;
+}
+
+void pause_audio(Audio* audio)
+{
+	/*
+	Stops the callback while the emulation thread doesn't produce samples, so a pause doesn't count as underruns.
+	The callback isn't running once SDL_PauseAudioDevice() returns, which makes it safe to start the ring over.
+	The next queue_audio_frame() starts it again.
+	*/
+	if (audio->device == 0 || audio->paused)
+		return;
+
+	SDL_PauseAudioDevice(audio->device, 1);
+	audio->paused = 1;
+	reset_ring(audio);
+}
+
+void queue_audio_frame(Audio* audio, const Chip8* chip)
+{
+	// Queues the samples of one displayed frame, the pattern plays while the sound timer isn't 0
+	if (audio->device == 0)
+		return;
+
+	Uint32 write = (Uint32)SDL_AtomicGet(&audio->write);
+	Uint32 queued = write - (Uint32)SDL_AtomicGet(&audio->read);
+
+	// Frames are produced faster than they are played, drop the start of this one to get back to the target latency
+	Uint32 skip = 0;
+	if (queued > AUDIO_MAX_QUEUED)
+	{
+		skip = queued - AUDIO_TARGET_QUEUED;
+		if (skip > AUDIO_FRAME_SAMPLES)
+			skip = AUDIO_FRAME_SAMPLES;
+
+		audio->overruns++;
+		audio->dropped_samples += skip;
+	}
+
+	if (queued > audio->max_queued)
+		audio->max_queued = queued;
+
+	audio->average_queued += (queued - audio->average_queued) / 16.0;
+
+	Uint8 playing = chip->sound_timer > 0;
+	double step = 4000.0 * pow(2.0, (chip->pitch - 64) / 48.0) / AUDIO_SAMPLE_RATE;	// Pattern samples per output sample
+
+	for (Uint32 i = 0; i < AUDIO_FRAME_SAMPLES; i++)
+	{
+		double value = 0.0;
+
+		if (playing)
+		{
+			int sample = (int)audio->position;
+			double fraction = audio->position - sample;
+			value = pattern_level(chip->audio_pattern, sample);
+
+			// Above the output rate the steps are closer together than the corrections are wide, it aliases anyway
+			if (step < 1.0)
+			{
+				if (fraction < step)
+				{
+					// Just after the step into this sample
+					double t = fraction / step;
+					value += (value - pattern_level(chip->audio_pattern, sample - 1)) * 0.5 * (t + t - t * t - 1.0);
+				}
+
+				if (fraction > 1.0 - step)
+				{
+					// Just before the step into the next sample
+					double t = (fraction - 1.0) / step;
+					value += (pattern_level(chip->audio_pattern, sample + 1) - value) * 0.5 * (t * t + t + t + 1.0);
+				}
+			}
+
+			audio->position += step;
+			if (audio->position >= 128.0)
+				audio->position -= 128.0;
+		}
+
+		if (i < skip)
+			continue;
+
+		audio->ring[write & AUDIO_RING_MASK] = (Sint16)(value * AUDIO_VOLUME);
+		write++;
+	}
+
+	SDL_AtomicSet(&audio->write, (int)write);
+
+	if (audio->paused)
+	{
+		SDL_PauseAudioDevice(audio->device, 0);
+		audio->paused = 0;
+	}
+}
+
+void audio_callback(void* userdata, Uint8* stream, int length)
+{
+	// Runs on SDL's audio thread
+	Audio* audio = (Audio*)userdata;
+	Sint16* out = (Sint16*)stream;
+	Uint32 wanted = (Uint32)length / sizeof(Sint16);
+
+	Uint32 read = (Uint32)SDL_AtomicGet(&audio->read);
+	Uint32 available = (Uint32)SDL_AtomicGet(&audio->write) - read;
+	Uint32 count = available < wanted ? available : wanted;
+
+	for (Uint32 i = 0; i < count; i++)
+		out[i] = audio->ring[(read + i) & AUDIO_RING_MASK];
+
+	if (count < wanted)
+	{
+		memset(&out[count], 0, (wanted - count) * sizeof(Sint16));
+		SDL_AtomicAdd(&audio->underruns, 1);
+		SDL_AtomicAdd(&audio->missing_samples, (int)(wanted - count));
+	}
+
+	SDL_AtomicSet(&audio->read, (int)(read + count));
+}
+
+double pattern_level(const Uint8* pattern, int sample)
+{
+	// +1 or -1 for the bit of the pattern sample, the pattern repeats
+	sample &= 127;
+	return (pattern[sample >> 3] >> (7 - (sample & 7)) & 1) ? 1.0 : -1.0;
+}
+
+void reset_ring(Audio* audio)
+{
+	// Starts the ring over with AUDIO_TARGET_QUEUED samples of silence, only while the callback isn't running
+	memset(audio->ring, 0, sizeof(audio->ring));
+	SDL_AtomicSet(&audio->read, 0);
+	SDL_AtomicSet(&audio->write, AUDIO_TARGET_QUEUED);
+	audio->average_queued = AUDIO_TARGET_QUEUED;
+	audio->rate = 1.0;
+}
+
+double audio_rate(Audio* audio)
+{
+	/*
+	How many times 1/60 s the next frame should take to keep AUDIO_TARGET_QUEUED samples queued, at most
+	AUDIO_MAX_RATE_DELTA away from 1. Pacing the frames with it makes the device's clock the master clock: every
+	frame queues the same number of samples, so the frames can only run as fast as the device plays them, however far
+	the host's counter and the device's crystal disagree. The correction grows with how far the average is off and
+	an average half a device buffer off gets all of it, so it's steering back well before a frame would overrun.
+	*/
+	if (audio->device == 0)
+		return 1.0;
+
+	double error = (audio->average_queued - AUDIO_TARGET_QUEUED) / (AUDIO_DEVICE_SAMPLES / 2);
+	if (error > 1.0)
+		error = 1.0;
+	if (error < -1.0)
+		error = -1.0;
+
+	audio->rate = 1.0 + AUDIO_MAX_RATE_DELTA * error;
+	return audio->rate;
+}
+
+void print_audio_stats(Audio* audio)
+{
+	if (audio->device == 0)
+		return;
+
+	int underruns = SDL_AtomicGet(&audio->underruns);
+	int missing_samples = SDL_AtomicGet(&audio->missing_samples);
+
+	printf("Audio underruns: %d (%d samples), overruns: %u (%u samples dropped), max latency: %.1f ms, rate: %+.3f%% \n",
+		underruns, missing_samples, audio->overruns, audio->dropped_samples,
+		(audio->max_queued + AUDIO_DEVICE_SAMPLES) * 1000.0 / AUDIO_SAMPLE_RATE, (audio->rate - 1.0) * 100.0);
+
+	// The callback may have counted more since, those are printed with the next stats instead of lost
+	SDL_AtomicAdd(&audio->underruns, -underruns);
+	SDL_AtomicAdd(&audio->missing_samples, -missing_samples);
+	audio->overruns = 0;
+	audio->dropped_samples = 0;
+	audio->max_queued = 0;
+}
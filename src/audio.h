@@ -0,0 +1,43 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <SDL.h>
+#include "chip8.h"
+
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_FRAME_SAMPLES (AUDIO_SAMPLE_RATE / 60)	// Samples produced per displayed frame
+#define AUDIO_RING_SIZE 4096			// Samples, a power of two
+#define AUDIO_DEVICE_SAMPLES 256		// Samples the callback is asked for at a time, 5.3 ms
+#define AUDIO_TARGET_QUEUED 384			// Samples queued when a frame starts, together with the device buffer 13 ms of latency
+#define AUDIO_MAX_QUEUED (AUDIO_TARGET_QUEUED + AUDIO_DEVICE_SAMPLES)	// Past this a frame drops samples, 18.7 ms of latency
+#define AUDIO_MAX_RATE_DELTA 0.005		// How far audio_rate() moves the frame rate away from 60 Hz
+
+/*
+The emulation thread writes the samples of every displayed frame into a ring that the SDL audio callback reads from.
+Only the emulation thread moves write and only the callback moves read, so neither side ever waits for the other.
+*/
+typedef struct {
+	SDL_AudioDeviceID device;		// 0 when no device could be opened, every function does nothing then
+	Sint16 ring[AUDIO_RING_SIZE];	// Mono signed 16-bit samples
+	SDL_atomic_t read;				// Samples the callback has played since the ring was last reset
+	SDL_atomic_t write;				// Samples the emulation thread has queued since the ring was last reset
+	double position;				// Position in the 128 samples of the audio pattern, carried from frame to frame
+	double average_queued;			// Moving average of the samples queued when a frame starts, what audio_rate() steers
+	double rate;					// The last audio_rate()
+	Uint8 paused;					// The callback is stopped until queue_audio_frame() queues the next frame
+
+	SDL_atomic_t underruns;			// Callbacks that found fewer samples than they needed and played silence instead
+	SDL_atomic_t missing_samples;
+	Uint32 overruns;				// Frames that found more than AUDIO_MAX_QUEUED samples queued
+	Uint32 dropped_samples;
+	Uint32 max_queued;
+} Audio;
+
+int open_audio(Audio* audio);
+void close_audio(Audio* audio);
+void queue_audio_frame(Audio* audio, const Chip8* chip);
+void pause_audio(Audio* audio);
+double audio_rate(Audio* audio);
+void print_audio_stats(Audio* audio);
+
+#endif
@@ -0,0 +1,214 @@
+#include "batch.h"
+
+#include "chip8.h"
+#include "chip8_jit.h"
+#include "host_thread.h"
+#include "movie.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Every worker thread owns a deque of job indices. The jobs are dealt out round robin up front, a worker takes
+its next job from the back of its own deque and, once that is empty, steals from the front of the other
+workers' deques, so a worker that drew short jobs keeps busy with someone else's long ones. Jobs never create
+new jobs, so a worker that finds every deque empty is done. A job runs a whole instance, which takes far
+longer than taking a lock, so every deque simply has its own mutex.
+*/
+
+typedef struct {
+	HostMutex lock;
+	uint32_t* indices;
+	uint32_t head;					// Next index to steal
+	uint32_t tail;					// One past the next index the owner takes
+} JobDeque;
+
+typedef struct {
+	BatchJob* jobs;
+	JobDeque* deques;
+	int worker_count;
+} Batch;
+
+typedef struct {
+	Batch* batch;
+	int index;
+	HostThread thread;
+	uint32_t steals;
+} BatchWorker;
+
+void run_worker(void* argument);
+int take_job(Batch* batch, int worker, uint32_t* job, uint32_t* steals);
+void run_job(BatchJob* job);
+
+int run_batch(BatchJob* jobs, uint32_t job_count, int worker_count, BatchStats* stats)
+{
+	if (worker_count <= 0)
+		worker_count = cpu_count();
+
+	if ((uint32_t)worker_count > job_count)
+		worker_count = job_count > 0 ? (int)job_count : 1;
+
+	Batch batch;
+	batch.jobs = jobs;
+	batch.worker_count = worker_count;
+	batch.deques = (JobDeque*)calloc(worker_count, sizeof(JobDeque));
+	BatchWorker* workers = (BatchWorker*)calloc(worker_count, sizeof(BatchWorker));
+	uint32_t* indices = (uint32_t*)malloc(sizeof(uint32_t) * (job_count > 0 ? job_count : 1));
+
+	if (batch.deques == NULL || workers == NULL || indices == NULL)
+	{
+		printf("Could not allocate the batch \n");
+		free(batch.deques);
+		free(workers);
+		free(indices);
+		return 1;
+	}
+
+	// Deal the jobs out round robin, every deque gets a contiguous slice of the index array
+	uint32_t next = 0;
+	for (int w = 0; w < worker_count; w++)
+	{
+		JobDeque* deque = &batch.deques[w];
+		init_mutex(&deque->lock);
+		deque->indices = &indices[next];
+		deque->head = 0;
+		deque->tail = 0;
+
+		for (uint32_t j = w; j < job_count; j += worker_count)
+			deque->indices[deque->tail++] = j;
+
+		next += deque->tail;
+	}
+
+	double start = host_seconds();
+
+	// The calling thread is worker 0
+	int started = 1;
+	for (int w = 0; w < worker_count; w++)
+	{
+		workers[w].batch = &batch;
+		workers[w].index = w;
+		workers[w].steals = 0;
+	}
+
+	for (int w = 1; w < worker_count; w++)
+	{
+		if (start_thread(&workers[w].thread, run_worker, &workers[w]) != 0)
+		{
+			printf("Could not start worker thread %d, running with %d \n", w, started);
+			break;
+		}
+		started++;
+	}
+
+	run_worker(&workers[0]);
+
+	for (int w = 1; w < started; w++)
+		join_thread(workers[w].thread);
+
+	if (stats != NULL)
+	{
+		stats->workers = started;
+		stats->steals = 0;
+		for (int w = 0; w < worker_count; w++)
+			stats->steals += workers[w].steals;
+		stats->seconds = host_seconds() - start;
+	}
+
+	for (int w = 0; w < worker_count; w++)
+		destroy_mutex(&batch.deques[w].lock);
+
+	free(batch.deques);
+	free(workers);
+	free(indices);
+	return 0;
+}
+
+void run_worker(void* argument)
+{
+	BatchWorker* worker = (BatchWorker*)argument;
+	uint32_t job;
+
+	while (take_job(worker->batch, worker->index, &job, &worker->steals))
+	{
+		worker->batch->jobs[job].worker = worker->index;
+		run_job(&worker->batch->jobs[job]);
+	}
+}
+
+int take_job(Batch* batch, int worker, uint32_t* job, uint32_t* steals)
+{
+	// Own deque first, from the back
+	JobDeque* own = &batch->deques[worker];
+	lock_mutex(&own->lock);
+	if (own->tail > own->head)
+	{
+		*job = own->indices[--own->tail];
+		unlock_mutex(&own->lock);
+		return 1;
+	}
+	unlock_mutex(&own->lock);
+
+	// Then the other workers, from the front, starting with the next one so thieves spread out
+	for (int i = 1; i < batch->worker_count; i++)
+	{
+		JobDeque* victim = &batch->deques[(worker + i) % batch->worker_count];
+		lock_mutex(&victim->lock);
+		if (victim->tail > victim->head)
+		{
+			*job = victim->indices[victim->head++];
+			unlock_mutex(&victim->lock);
+			(*steals)++;
+			return 1;
+		}
+		unlock_mutex(&victim->lock);
+	}
+
+	return 0;
+}
+
+void run_job(BatchJob* job)
+{
+	job->status = 1;
+
+	Chip8* chip = create_chip();
+	if (chip == NULL)
+		return;
+
+	if (job->cycles_per_frame > 0)
+		chip->cycles_per_frame = job->cycles_per_frame;
+
+	seed_chip(chip, job->seed);
+	set_quirk_profile(chip, (QuirkProfile)job->quirks);
+
+	if (load_program(chip, job->program, job->program_size) != 0)
+	{
+		destroy_chip(chip);
+		return;
+	}
+
+#ifdef CHIPPY_JIT
+	create_jit(chip);
+#endif
+
+	job->status = 0;
+	if (job->movie != NULL)
+	{
+		if (play_movie(job->movie, chip, &job->mismatch_frame) != 0)
+			job->status = 2;
+	}
+	else
+	{
+		for (uint32_t frame = 0; frame < job->frames; frame++)
+		{
+			while (emulate_frame(chip) == EXIT_FRAME_DRAWN)
+				;
+		}
+	}
+
+	job->display_hash = display_hash(chip);
+	job->cycles = chip->cycles;
+
+	destroy_chip(chip);
+}
@@ -0,0 +1,35 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Movie;
+
+// One independent instance for run_batch(), the results are filled in when it has run
+typedef struct {
+	const char* rom_name;
+	const uint8_t* program;			// ROM image, may be shared by any number of jobs
+	size_t program_size;
+	uint32_t frames;				// Emulated frames to run
+	uint32_t cycles_per_frame;		// 0 keeps the default
+	uint32_t seed;					// Seed for CXNN, see seed_chip()
+	uint8_t quirks;					// QuirkProfile
+	const struct Movie* movie;		// Replay this instead, it sets the frames, cycles per frame, seed and quirks
+
+	int status;						// 0 if the instance ran, 1 if it couldn't be created, 2 if the replay didn't match the movie
+	uint32_t mismatch_frame;		// The first checkpoint of the movie that didn't match
+	uint64_t display_hash;			// display_hash() after the last frame
+	uint64_t cycles;				// Instructions executed
+	int worker;						// Index of the worker thread that ran it
+} BatchJob;
+
+typedef struct {
+	int workers;
+	uint32_t steals;				// Jobs taken from another worker's deque
+	double seconds;					// Wall clock time for the whole batch
+} BatchStats;
+
+int run_batch(BatchJob* jobs, uint32_t job_count, int worker_count, BatchStats* stats);
+
+#endif
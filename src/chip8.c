@@ -1,8 +1,14 @@
 #include "chip8.h"
+#include "chip8_jit.h"
+#include "mapped_file.h"
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 // Function prototypes
 void fetch_opcode(Chip8*);
@@ -10,24 +16,72 @@ void next_opcode(Chip8* chip);
 void skip_next_opcode(Chip8* chip);
 void stack_push(Chip8* chip);
 void stack_pop(Chip8* chip);
-void x_0(Chip8*);
-void x_1(Chip8*);
-void x_2(Chip8*);
-void x_3(Chip8*);
-void x_4(Chip8*);
-void x_5(Chip8*);
-void x_6(Chip8*);
-void x_7(Chip8*);
-void x_8(Chip8*);
-void x_9(Chip8*);
-void x_a(Chip8*);
-void x_b(Chip8*);
-void x_c(Chip8*);
-void x_d(Chip8*);
-void x_e(Chip8*);
-void x_f(Chip8*);
-
-Uint8 fontset[80] =
+void x_00e0(Chip8*, const Instruction*);
+void x_00ee(Chip8*, const Instruction*);
+void x_00cn(Chip8*, const Instruction*);
+void x_00dn(Chip8*, const Instruction*);
+void x_00fb(Chip8*, const Instruction*);
+void x_00fc(Chip8*, const Instruction*);
+void x_00fd(Chip8*, const Instruction*);
+void x_00fe(Chip8*, const Instruction*);
+void x_00ff(Chip8*, const Instruction*);
+void x_1(Chip8*, const Instruction*);
+void x_2(Chip8*, const Instruction*);
+void x_3(Chip8*, const Instruction*);
+void x_4(Chip8*, const Instruction*);
+void x_5(Chip8*, const Instruction*);
+void x_5xy2(Chip8*, const Instruction*);
+void x_5xy3(Chip8*, const Instruction*);
+void x_6(Chip8*, const Instruction*);
+void x_7(Chip8*, const Instruction*);
+void x_8xy0(Chip8*, const Instruction*);
+void x_8xy1(Chip8*, const Instruction*);
+void x_8xy1_vf_reset(Chip8*, const Instruction*);
+void x_8xy2(Chip8*, const Instruction*);
+void x_8xy2_vf_reset(Chip8*, const Instruction*);
+void x_8xy3(Chip8*, const Instruction*);
+void x_8xy3_vf_reset(Chip8*, const Instruction*);
+void x_8xy4(Chip8*, const Instruction*);
+void x_8xy5(Chip8*, const Instruction*);
+void x_8xy6(Chip8*, const Instruction*);
+void x_8xy6_vy(Chip8*, const Instruction*);
+void x_8xy7(Chip8*, const Instruction*);
+void x_8xye(Chip8*, const Instruction*);
+void x_8xye_vy(Chip8*, const Instruction*);
+void x_9(Chip8*, const Instruction*);
+void x_a(Chip8*, const Instruction*);
+void x_b(Chip8*, const Instruction*);
+void x_bxnn(Chip8*, const Instruction*);
+void x_c(Chip8*, const Instruction*);
+void x_d(Chip8*, const Instruction*);
+void x_d_clip(Chip8*, const Instruction*);
+void x_ex9e(Chip8*, const Instruction*);
+void x_exa1(Chip8*, const Instruction*);
+void x_f000(Chip8*, const Instruction*);
+void x_fn01(Chip8*, const Instruction*);
+void x_f002(Chip8*, const Instruction*);
+void x_fx07(Chip8*, const Instruction*);
+void x_fx0a(Chip8*, const Instruction*);
+void x_fx15(Chip8*, const Instruction*);
+void x_fx18(Chip8*, const Instruction*);
+void x_fx1e(Chip8*, const Instruction*);
+void x_fx29(Chip8*, const Instruction*);
+void x_fx30(Chip8*, const Instruction*);
+void x_fx33(Chip8*, const Instruction*);
+void x_fx3a(Chip8*, const Instruction*);
+void x_fx55(Chip8*, const Instruction*);
+void x_fx55_i(Chip8*, const Instruction*);
+void x_fx65(Chip8*, const Instruction*);
+void x_fx65_i(Chip8*, const Instruction*);
+void x_fx75(Chip8*, const Instruction*);
+void x_fx85(Chip8*, const Instruction*);
+void x_unsupported(Chip8*, const Instruction*);
+uint8_t draw_planes(DisplayBuffer* display, const uint8_t* memory, uint8_t x, uint8_t y, uint16_t address, uint8_t height, uint8_t clip);
+uint8_t draw_lores_sprite(uint64_t rows[64][2], const uint8_t* memory, uint8_t x, uint8_t y, uint16_t address, uint8_t height, uint8_t clip);
+uint8_t draw_hires_sprite(uint64_t rows[64][2], const uint8_t* memory, uint8_t x, uint8_t y, uint16_t address, uint8_t height, uint8_t clip);
+uint64_t sprite_row(const uint8_t* memory, uint16_t address, uint8_t row, uint8_t wide);
+
+uint8_t fontset[80] =
 {
 	0xF0, 0x90, 0x90, 0x90, 0xF0, //0
 	0x20, 0x60, 0x20, 0x20, 0x70, //1
@@ -47,445 +101,1148 @@ Uint8 fontset[80] =
 	0xF0, 0x80, 0xF0, 0x80, 0x80  //F
 };
 
-void (*opcode_handlers[16])(Chip8*) = 
-{ 
-	x_0, x_1, x_2, x_3, x_4, x_5, x_6, x_7,
-	x_8, x_9, x_a, x_b, x_c, x_d, x_e, x_f
+// The 8x10 characters FX30 points at, SUPER-CHIP only had the digits, A to F are the ones most interpreters added
+uint8_t big_fontset[160] =
+{
+	0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, //0
+	0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, //1
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, //2
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, //3
+	0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, //4
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, //5
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, //6
+	0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, //7
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, //8
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, //9
+	0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, //A
+	0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, //B
+	0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, //C
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, //D
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, //E
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  //F
+};
+
+// Indexed by QuirkProfile
+const char* quirk_profile_names[QUIRKS_COUNT] = { "modern", "cosmac", "schip", "xochip" };
+uint8_t quirk_profile_flags[QUIRKS_COUNT] = { QUIRKS_MODERN_FLAGS, QUIRKS_COSMAC_FLAGS, QUIRKS_SCHIP_FLAGS, QUIRKS_XOCHIP_FLAGS };
+
+// Every page of the decode cache that hasn't been allocated yet points here, it is never written to
+Instruction empty_code_page[CHIP8_CODE_PAGE_SIZE / 2];
+
+/*
+Handlers indexed by QuirkProfile and OpcodeForm. The forms a quirk changes have a handler for either behaviour
+and the table of a profile only has the ones its flags pick, so no handler checks the quirks while it runs.
+decode_opcode() caches the handler of the chip's profile, set_quirk_profile() drops the cache when it changes.
+*/
+#define QUIRK_HANDLER(flags, quirk, with, without) (((flags) & QUIRK_##quirk) ? with : without)
+#define FORM_HANDLERS(flags) \
+{ \
+	x_unsupported, \
+	x_00e0, x_00ee, x_00cn, x_00dn, x_00fb, x_00fc, x_00fd, x_00fe, x_00ff, x_1, x_2, x_3, x_4, x_5, x_5xy2, x_5xy3, x_6, x_7, \
+	x_8xy0, \
+	QUIRK_HANDLER(flags, LOGIC_VF_RESET, x_8xy1_vf_reset, x_8xy1), \
+	QUIRK_HANDLER(flags, LOGIC_VF_RESET, x_8xy2_vf_reset, x_8xy2), \
+	QUIRK_HANDLER(flags, LOGIC_VF_RESET, x_8xy3_vf_reset, x_8xy3), \
+	x_8xy4, x_8xy5, QUIRK_HANDLER(flags, SHIFT_VY, x_8xy6_vy, x_8xy6), x_8xy7, QUIRK_HANDLER(flags, SHIFT_VY, x_8xye_vy, x_8xye), \
+	x_9, x_a, QUIRK_HANDLER(flags, JUMP_VX, x_bxnn, x_b), x_c, QUIRK_HANDLER(flags, CLIP_SPRITES, x_d_clip, x_d), x_ex9e, x_exa1, \
+	x_f000, x_fn01, x_f002, x_fx07, x_fx0a, x_fx15, x_fx18, x_fx1e, x_fx29, x_fx30, x_fx33, x_fx3a, \
+	QUIRK_HANDLER(flags, LOAD_STORE_I, x_fx55_i, x_fx55), QUIRK_HANDLER(flags, LOAD_STORE_I, x_fx65_i, x_fx65), x_fx75, x_fx85 \
+}
+
+void (*form_handlers[QUIRKS_COUNT][OP_COUNT])(Chip8*, const Instruction*) =
+{
+	FORM_HANDLERS(QUIRKS_MODERN_FLAGS),
+	FORM_HANDLERS(QUIRKS_COSMAC_FLAGS),
+	FORM_HANDLERS(QUIRKS_SCHIP_FLAGS),
+	FORM_HANDLERS(QUIRKS_XOCHIP_FLAGS)
+};
+
+#undef QUIRK_HANDLER
+#undef FORM_HANDLERS
+
+// Opcode forms that are fully identified by their highest nibble, the rest are resolved in decode_opcode
+uint8_t nibble_forms[16] =
+{
+	OP_UNSUPPORTED, OP_1NNN, OP_2NNN, OP_3XNN, OP_4XNN, OP_5XY0, OP_6XNN, OP_7XNN,
+	OP_UNSUPPORTED, OP_9XY0, OP_ANNN, OP_BNNN, OP_CXNN, OP_DXYN, OP_UNSUPPORTED, OP_UNSUPPORTED
 };
 
+#ifndef CHIPPY_THREADED_CORE
 void emulate(Chip8* chip)
 {
-	fetch_opcode(chip);
-	
+	Instruction odd_instruction;
+	const Instruction* instruction = fetch_instruction(chip, &odd_instruction);
+	instruction->handler(chip, instruction);
+	chip->cycles++;
+}
+#else
+void emulate(Chip8* chip)
+{
+	emulate_cycles(chip, 1);
+}
+#endif
+
+ExitReason emulate_frame(Chip8* chip)
+{
 	/*
-	Example:
-		Opcode = FFFF
-		(chip->opcode & 0xF000) --> F000 --> (F000 >> 12) --> 000F
-		Invoke the function at index 15 in the handler array
+	One frame is 1/60 s of emulated time: cycles_per_frame instructions followed by one tick of the timers.
+	The frame stops early when the display changes so the host can show it, the next call picks up where it left off.
+	A ROM that waits for a key or hit an unsupported opcode would only spin for the rest of the frame, so the frame ends right away.
+	A ROM in an idle loop skips the rest of the frame, the chip ends up exactly where running the loop would have left it.
 	*/
+	while (chip->frame_cycles < chip->cycles_per_frame)
+	{
+		uint64_t start_cycles = chip->cycles;
+		ExitReason reason;
+
+		if (chip->jit != NULL)
+		{
+			// A block can end in a jump to itself, so the idle loops are caught before they run.
+			// FX0A is never compiled, it runs below and ends the frame after one cycle like in the interpreter
+			IdleLoop loop = idle_loop(chip, chip->program_counter);
+			if (loop != IDLE_NONE && loop != IDLE_KEY_WAIT)
+			{
+				skip_idle_loop(chip, loop, chip->cycles_per_frame - chip->frame_cycles);
+				tick_timers(chip);
+				return EXIT_IDLE;
+			}
+
+			reason = emulate_jit(chip, chip->cycles_per_frame - chip->frame_cycles);
+		}
+		else
+			reason = emulate_cycles(chip, chip->cycles_per_frame - chip->frame_cycles);
+
+		chip->frame_cycles += (uint32_t)(chip->cycles - start_cycles);
+
+		if (reason == EXIT_FRAME_DRAWN && chip->frame_cycles < chip->cycles_per_frame)
+			return EXIT_FRAME_DRAWN;
+
+		if (reason == EXIT_WAITING_FOR_KEY || reason == EXIT_UNSUPPORTED_OPCODE)
+		{
+			tick_timers(chip);
+			return reason;
+		}
+
+		if (reason == EXIT_IDLE)
+		{
+			skip_idle_loop(chip, idle_loop(chip, chip->program_counter), chip->cycles_per_frame - chip->frame_cycles);
+			tick_timers(chip);
+			return reason;
+		}
+	}
 
-	Uint8 index = (chip->opcode & 0xF000) >> 12;
-	opcode_handlers[index](chip);
+	tick_timers(chip);
+	return EXIT_BUDGET_EXHAUSTED;
+}
 
-	// Update the sound and delay timer
+void tick_timers(Chip8* chip)
+{
+	// Update the sound and delay timer, 60 times per second of emulated time
 	if (chip->sound_timer > 0)
-	{
 		chip->sound_timer--;
-	}
 
 	if (chip->delay_timer > 0)
 		chip->delay_timer--;
+
+	chip->frame_cycles = 0;
+}
+
+IdleLoop idle_loop(const Chip8* chip, uint16_t address)
+{
+	/*
+	Recognises the loops ROMs wait in. Nothing in them can change before the timers tick at the end of the frame
+	or, for FX0A, before a key goes down, so the rest of the frame can be skipped. Only the start of a loop is recognised,
+	the cores check when they jump back to it.
+	*/
+	if (address & 1 || address > CHIP8_MEMORY_SIZE - 6)
+		return IDLE_NONE;
+
+	const uint8_t* code = &chip->memory[address];
+	uint16_t opcode = code[0] << 8 | code[1];
+
+	if (opcode == (0x1000 | address))
+		return IDLE_JUMP;
+
+	if (opcode == 0x00FD)
+		return IDLE_EXIT;
+
+	if ((opcode & 0xF0FF) == 0xF00A)
+		return chip->keys != 0 ? IDLE_NONE : IDLE_KEY_WAIT;
+
+	// FX07, 3X00, 1NNN back to the FX07. 3X00 only skips out of the loop once the delay timer is 0
+	if ((opcode & 0xF0FF) == 0xF007 && chip->delay_timer != 0
+		&& (code[2] << 8 | code[3]) == (0x3000 | (opcode & 0x0F00))
+		&& (code[4] << 8 | code[5]) == (0x1000 | address))
+		return IDLE_DELAY_POLL;
+
+	return IDLE_NONE;
+}
+
+void skip_idle_loop(Chip8* chip, IdleLoop loop, uint32_t cycles)
+{
+	// Leaves the chip as running the loop at the program counter for cycles instructions would have
+	if (loop == IDLE_DELAY_POLL && cycles > 0)
+	{
+		chip->V[chip->memory[chip->program_counter] & 0x0F] = chip->delay_timer;
+		chip->program_counter += (cycles % 3) * 2;
+	}
+
+	chip->cycles += cycles;
+	chip->frame_cycles += cycles;
+}
+
+const Instruction* fetch_instruction(Chip8* chip, Instruction* odd_instruction)
+{
+	/*
+	The decoded instruction is cached per address, the opcode only has to be fetched and decoded
+	the first time the address is executed or after the memory at the address has been written to.
+	Opcodes at odd addresses are rare and are decoded into odd_instruction instead of being cached.
+
+	The cache covers all 64 KB of memory in pages that are only allocated when code in them is decoded,
+	until then a page is empty_code_page and every lookup in it misses. A CHIP-8 ROM only ever allocates the
+	pages its code is in, and finding a slot is the same two loads wherever in memory the code is.
+	*/
+	uint16_t pc = chip->program_counter;
+	Instruction* instruction = &chip->code_pages[pc / CHIP8_CODE_PAGE_SIZE][(pc % CHIP8_CODE_PAGE_SIZE) >> 1];
+
+	if (pc & 1)
+	{
+		fetch_opcode(chip);
+		decode_opcode(chip->opcode, chip->quirks, odd_instruction);
+		return odd_instruction;
+	}
+	
+	if (instruction->handler == NULL)
+	{
+		fetch_opcode(chip);
+
+		if (chip->code_pages[pc / CHIP8_CODE_PAGE_SIZE] == empty_code_page)
+		{
+			Instruction* page = (Instruction*)calloc(CHIP8_CODE_PAGE_SIZE / 2, sizeof(Instruction));
+			if (page == NULL)
+			{
+				// Runs uncached rather than not at all
+				decode_opcode(chip->opcode, chip->quirks, odd_instruction);
+				return odd_instruction;
+			}
+
+			chip->code_pages[pc / CHIP8_CODE_PAGE_SIZE] = page;
+			instruction = &page[(pc % CHIP8_CODE_PAGE_SIZE) >> 1];
+		}
+
+		decode_opcode(chip->opcode, chip->quirks, instruction);
+	}
+
+	chip->opcode = instruction->opcode;
+	return instruction;
 }
 
-void x_0(Chip8* chip)
+void decode_opcode(uint16_t opcode, uint8_t profile, Instruction* instruction)
 {
-	switch (chip->opcode & 0x000F)
+	/*
+	Example:
+		Opcode = 8AB4
+		(opcode & 0xF000) --> 8000 --> (8000 >> 12) --> 0008
+		Group 8 is resolved by the lowest nibble --> 0004 --> OP_8XY4
+
+	F000 NNNN is decoded from its first word only, the address is read from memory when it runs.
+	*/
+	uint8_t form = nibble_forms[(opcode & 0xF000) >> 12];
+
+	switch (opcode & 0xF000)
 	{
-		case 0x0000: // 0x00E0: Clears the screen
-			for (int i = 0; i < 2048; i++)
-				chip->display_buffer[i] = 0x0;
-			chip->redraw = 1;
-			//next_opcode(chip);
-			next_opcode(chip);
+		case 0x0000:
+			// Other 0NN0 and 0NNE opcodes have always run as 00E0 and 00EE
+			switch (opcode & 0x0FFF)
+			{
+				case 0x00FB: form = OP_00FB; break;
+				case 0x00FC: form = OP_00FC; break;
+				case 0x00FD: form = OP_00FD; break;
+				case 0x00FE: form = OP_00FE; break;
+				case 0x00FF: form = OP_00FF; break;
+				default:
+					if ((opcode & 0x0FF0) == 0x00C0)
+						form = OP_00CN;
+					else if ((opcode & 0x0FF0) == 0x00D0)
+						form = OP_00DN;
+					else if ((opcode & 0x000F) == 0x0000)
+						form = OP_00E0;
+					else if ((opcode & 0x000F) == 0x000E)
+						form = OP_00EE;
+					break;
+			}
+			break;
+
+		case 0x5000:
+			// Other 5XYN opcodes have always run as 5XY0
+			switch (opcode & 0x000F)
+			{
+				case 0x0002: form = OP_5XY2; break;
+				case 0x0003: form = OP_5XY3; break;
+			}
+			break;
+
+		case 0x8000:
+			switch (opcode & 0x000F)
+			{
+				case 0x0000: form = OP_8XY0; break;
+				case 0x0001: form = OP_8XY1; break;
+				case 0x0002: form = OP_8XY2; break;
+				case 0x0003: form = OP_8XY3; break;
+				case 0x0004: form = OP_8XY4; break;
+				case 0x0005: form = OP_8XY5; break;
+				case 0x0006: form = OP_8XY6; break;
+				case 0x0007: form = OP_8XY7; break;
+				case 0x000E: form = OP_8XYE; break;
+			}
+			break;
+
+		case 0xE000:
+			switch (opcode & 0x00FF)
+			{
+				case 0x009E: form = OP_EX9E; break;
+				case 0x00A1: form = OP_EXA1; break;
+			}
 			break;
 
-		case 0x000E: // 0x00EE: Returns from subroutine
-			stack_pop(chip);
-			next_opcode(chip);
+		case 0xF000:
+			switch (opcode & 0x00FF)
+			{
+				case 0x0000: form = opcode == 0xF000 ? OP_F000 : OP_UNSUPPORTED; break;
+				case 0x0001: form = OP_FN01; break;
+				case 0x0002: form = opcode == 0xF002 ? OP_F002 : OP_UNSUPPORTED; break;
+				case 0x0007: form = OP_FX07; break;
+				case 0x000A: form = OP_FX0A; break;
+				case 0x0015: form = OP_FX15; break;
+				case 0x0018: form = OP_FX18; break;
+				case 0x001E: form = OP_FX1E; break;
+				case 0x0029: form = OP_FX29; break;
+				case 0x0030: form = OP_FX30; break;
+				case 0x0033: form = OP_FX33; break;
+				case 0x003A: form = OP_FX3A; break;
+				case 0x0055: form = OP_FX55; break;
+				case 0x0065: form = OP_FX65; break;
+				case 0x0075: form = OP_FX75; break;
+				case 0x0085: form = OP_FX85; break;
+			}
 			break;
+	}
+
+	instruction->opcode = opcode;
+	instruction->nnn = opcode & 0x0FFF;
+	instruction->x = (opcode & 0x0F00) >> 8;
+	instruction->y = (opcode & 0x00F0) >> 4;
+	instruction->n = opcode & 0x000F;
+	instruction->nn = opcode & 0x00FF;
+	instruction->form = form;
+	instruction->handler = form_handlers[profile][form];
+}
+
+void invalidate_code(Chip8* chip, uint16_t address)
+{
+	// A write to either byte of an even address invalidates the instruction decoded from it
+	drop_decoded(chip, address, 1);
+	chip->dirty_pages[address / CHIP8_PAGE_SIZE / 64] |= (uint64_t)1 << (address / CHIP8_PAGE_SIZE % 64);
+
+	if (chip->jit != NULL)
+		jit_invalidate(chip, address);
+}
+
+void drop_decoded(Chip8* chip, uint16_t address, uint32_t size)
+{
+	// Drops the instructions decoded from size bytes of memory at address, pages that were never allocated have none
+	for (uint32_t offset = 0; offset < size; offset++)
+	{
+		uint16_t slot = (uint16_t)(address + offset);
+		Instruction* page = chip->code_pages[slot / CHIP8_CODE_PAGE_SIZE];
 
-		default:
-			printf("Unsupported opcode: 0x%X\n", chip->opcode);
+		if (page != empty_code_page)
+			page[(slot % CHIP8_CODE_PAGE_SIZE) >> 1].handler = NULL;
+	}
+}
+
+void flush_decoded(Chip8* chip)
+{
+	// Drops every decoded instruction, the pages stay allocated for the code that is decoded next
+	for (int page = 0; page < CHIP8_CODE_PAGES; page++)
+	{
+		if (chip->code_pages[page] != empty_code_page)
+			memset(chip->code_pages[page], 0, sizeof(Instruction) * CHIP8_CODE_PAGE_SIZE / 2);
 	}
 }
 
-void x_1(Chip8* chip)
+void x_00e0(Chip8* chip, const Instruction* instruction)
+{
+	// 0x00E0: Clears the screen
+	clear_display(&chip->display_buffer);
+	chip->redraw = 1;
+	next_opcode(chip);
+}
+
+void x_00ee(Chip8* chip, const Instruction* instruction)
+{
+	// 0x00EE: Returns from subroutine
+	stack_pop(chip);
+	next_opcode(chip);
+}
+
+void x_00cn(Chip8* chip, const Instruction* instruction)
+{
+	// 0x00CN: Scrolls the display down by N rows
+	scroll_down(&chip->display_buffer, instruction->n);
+	chip->redraw = 1;
+	next_opcode(chip);
+}
+
+void x_00dn(Chip8* chip, const Instruction* instruction)
+{
+	// 0x00DN: Scrolls the display up by N rows, XO-CHIP added it
+	scroll_up(&chip->display_buffer, instruction->n);
+	chip->redraw = 1;
+	next_opcode(chip);
+}
+
+void x_00fb(Chip8* chip, const Instruction* instruction)
+{
+	// 0x00FB: Scrolls the display right by 4 pixels
+	scroll_right(&chip->display_buffer);
+	chip->redraw = 1;
+	next_opcode(chip);
+}
+
+void x_00fc(Chip8* chip, const Instruction* instruction)
+{
+	// 0x00FC: Scrolls the display left by 4 pixels
+	scroll_left(&chip->display_buffer);
+	chip->redraw = 1;
+	next_opcode(chip);
+}
+
+void x_00fd(Chip8* chip, const Instruction* instruction)
+{
+	// 0x00FD: Exits the interpreter
+	// The program counter stays on it, every frame from now on is idle
+}
+
+void x_00fe(Chip8* chip, const Instruction* instruction)
+{
+	// 0x00FE: Switches to the 64x32 display
+	set_resolution(&chip->display_buffer, 0);
+	chip->redraw = 1;
+	next_opcode(chip);
+}
+
+void x_00ff(Chip8* chip, const Instruction* instruction)
+{
+	// 0x00FF: Switches to the 128x64 display of SUPER-CHIP
+	set_resolution(&chip->display_buffer, 1);
+	chip->redraw = 1;
+	next_opcode(chip);
+}
+
+void x_1(Chip8* chip, const Instruction* instruction)
 {
 	// 0x1NNN: Jumps to address NNN
 	// We don't need to increment the program counter here since where jumping to a specified address
-	chip->program_counter = chip->opcode & 0x0FFF;
+	chip->program_counter = instruction->nnn;
 }
 
-void x_2(Chip8* chip)
+void x_2(Chip8* chip, const Instruction* instruction)
 {
 	// 0x2NNN: Calls subroutine at NNN
 	stack_push(chip);
-	chip->program_counter = chip->opcode & 0x0FFF;				// Set the program counter to the address at NNN
+	chip->program_counter = instruction->nnn;				// Set the program counter to the address at NNN
 }
 
-void x_3(Chip8* chip)
+void x_3(Chip8* chip, const Instruction* instruction)
 {
 	// 0x3XNN: Skips the next instruction if VX equals NN
-	Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-	Uint8 nn = (chip->opcode & 0x00FF);
-	if (chip->V[register_index] == nn)
+	if (chip->V[instruction->x] == instruction->nn)
 		skip_next_opcode(chip);
 	else
 		next_opcode(chip);
 }
 
-void x_4(Chip8* chip)
+void x_4(Chip8* chip, const Instruction* instruction)
 {
 	// 0x4XNN: Skips the next instruction if VX doesn't equal NN
-	Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-	Uint8 nn = (chip->opcode & 0x00FF);
-	if (chip->V[register_index] != nn)
+	if (chip->V[instruction->x] != instruction->nn)
 		skip_next_opcode(chip);
 	else
 		next_opcode(chip);
 }
 
-void x_5(Chip8* chip)
+void x_5(Chip8* chip, const Instruction* instruction)
 {
 	// 0x5XY0: Skips the next instruction if VX equals VY
-	Uint8 register_index_x = (chip->opcode & 0x0F00) >> 8;
-	Uint8 register_index_y = (chip->opcode & 0x00F0) >> 4;
-	if (chip->V[register_index_x] == chip->V[register_index_y])
+	if (chip->V[instruction->x] == chip->V[instruction->y])
 		skip_next_opcode(chip);
 	else
 		next_opcode(chip);
 }
 
-void x_6(Chip8* chip)
+void x_5xy2(Chip8* chip, const Instruction* instruction)
 {
-	// 0x6XNN: Sets VX to NN
-	Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-	Uint8 nn = chip->opcode & 0x00FF;
-	chip->V[register_index] = nn;
-	next_opcode(chip);
-}
+	// 0x5XY2: Stores VX to VY in memory starting at address I, in reverse order when X is greater than Y. I doesn't change
+	uint8_t count = instruction->x < instruction->y ? instruction->y - instruction->x : instruction->x - instruction->y;
+	int8_t step = instruction->x < instruction->y ? 1 : -1;
+
+	for (uint8_t i = 0; i <= count; i++)
+	{
+		uint16_t address = (uint16_t)(chip->I + i);
+		chip->memory[address] = chip->V[instruction->x + i * step];
+		invalidate_code(chip, address);
+	}
 
-void x_7(Chip8* chip)
-{
-	// 0x7XNN: Adds NN to VX
-	Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-	Uint8 nn = chip->opcode & 0x00FF;
-	chip->V[register_index] += nn;
 	next_opcode(chip);
 }
 
-void x_8(Chip8* chip)
+void x_5xy3(Chip8* chip, const Instruction* instruction)
 {
-	switch (chip->opcode & 0x000F)
-	{
-		case 0x0000: { // 0x8XY0: Sets VX to the value of VY
-			Uint8 register_index_x = (chip->opcode & 0x0F00) >> 8;
-			Uint8 register_index_y = (chip->opcode & 0x00F0) >> 4;
+	// 0x5XY3: Fills VX to VY with values from memory starting at address I, in reverse order when X is greater than Y
+	uint8_t count = instruction->x < instruction->y ? instruction->y - instruction->x : instruction->x - instruction->y;
+	int8_t step = instruction->x < instruction->y ? 1 : -1;
 
-			chip->V[register_index_x] = chip->V[register_index_y];
+	for (uint8_t i = 0; i <= count; i++)
+		chip->V[instruction->x + i * step] = chip->memory[(uint16_t)(chip->I + i)];
 
-			next_opcode(chip);
-			break;
-		}
-		case 0x0001: { // 0x8XY1: Sets VX to "VX OR VY"
-			Uint8 register_index_x = (chip->opcode & 0x0F00) >> 8;
-			Uint8 register_index_y = (chip->opcode & 0x00F0) >> 4;
+	next_opcode(chip);
+}
 
-			chip->V[register_index_x] |= chip->V[register_index_y];
+void x_6(Chip8* chip, const Instruction* instruction)
+{
+	// 0x6XNN: Sets VX to NN
+	chip->V[instruction->x] = instruction->nn;
+	next_opcode(chip);
+}
 
-			next_opcode(chip);
-			break;
-		}
-		case 0x0002: { // 0x8XY2: Sets VX to "VX AND VY"
-			Uint8 register_index_x = (chip->opcode & 0x0F00) >> 8;
-			Uint8 register_index_y = (chip->opcode & 0x00F0) >> 4;
+void x_7(Chip8* chip, const Instruction* instruction)
+{
+	// 0x7XNN: Adds NN to VX
+	chip->V[instruction->x] += instruction->nn;
+	next_opcode(chip);
+}
 
-			chip->V[register_index_x] &= chip->V[register_index_y];
+void x_8xy0(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XY0: Sets VX to the value of VY
+	chip->V[instruction->x] = chip->V[instruction->y];
+	next_opcode(chip);
+}
 
-			next_opcode(chip);
-			break;
-		}
-		case 0x0003: { // 0x8XY3: Sets VX to "VX XOR VY"
-			Uint8 register_index_x = (chip->opcode & 0x0F00) >> 8;
-			Uint8 register_index_y = (chip->opcode & 0x00F0) >> 4;
+void x_8xy1(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XY1: Sets VX to "VX OR VY"
+	chip->V[instruction->x] |= chip->V[instruction->y];
+	next_opcode(chip);
+}
 
-			chip->V[register_index_x] ^= chip->V[register_index_y];
+void x_8xy1_vf_reset(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XY1 on the COSMAC VIP, the logic ops left VF at 0
+	x_8xy1(chip, instruction);
+	chip->V[0xF] = 0;
+}
 
-			next_opcode(chip);
-			break;
-		}
-		case 0x0004: { // 0x8XY4: Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't
-			Uint8 register_index_x = (chip->opcode & 0x0F00) >> 8;
-			Uint8 register_index_y = (chip->opcode & 0x00F0) >> 4;
+void x_8xy2(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XY2: Sets VX to "VX AND VY"
+	chip->V[instruction->x] &= chip->V[instruction->y];
+	next_opcode(chip);
+}
 
-			if (chip->V[register_index_y] > (0xFF - chip->V[register_index_x]))
-				chip->V[0xF] = 1; // There is a carry
-			else
-				chip->V[0xF] = 0;
+void x_8xy2_vf_reset(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XY2 on the COSMAC VIP, the logic ops left VF at 0
+	x_8xy2(chip, instruction);
+	chip->V[0xF] = 0;
+}
 
-			chip->V[register_index_x] += chip->V[register_index_y];
+void x_8xy3(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XY3: Sets VX to "VX XOR VY"
+	chip->V[instruction->x] ^= chip->V[instruction->y];
+	next_opcode(chip);
+}
 
-			next_opcode(chip);
-			break;
-		}
-		case 0x0005: { // 0x8XY5: VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't
-			Uint8 register_index_x = (chip->opcode & 0x0F00) >> 8;
-			Uint8 register_index_y = (chip->opcode & 0x00F0) >> 4;
+void x_8xy3_vf_reset(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XY3 on the COSMAC VIP, the logic ops left VF at 0
+	x_8xy3(chip, instruction);
+	chip->V[0xF] = 0;
+}
 
-			if (chip->V[register_index_y] > chip->V[register_index_x])
-				chip->V[0xF] = 0; // There is a borrow
-			else
-				chip->V[0xF] = 1;
+void x_8xy4(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XY4: Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't
+	if (chip->V[instruction->y] > (0xFF - chip->V[instruction->x]))
+		chip->V[0xF] = 1; // There is a carry
+	else
+		chip->V[0xF] = 0;
 
-			chip->V[register_index_x] -= chip->V[register_index_y];
+	chip->V[instruction->x] += chip->V[instruction->y];
+	next_opcode(chip);
+}
 
-			next_opcode(chip);
-			break;
-		}
-		case 0x0006: { // 0x8XY6: Shifts VX right by one. VF is set to the value of the least significant bit of VX before the shift
-			Uint8 register_index_x = (chip->opcode & 0x0F00) >> 8;
+void x_8xy5(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XY5: VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't
+	if (chip->V[instruction->y] > chip->V[instruction->x])
+		chip->V[0xF] = 0; // There is a borrow
+	else
+		chip->V[0xF] = 1;
 
-			chip->V[0xF] = chip->V[register_index_x] & 0x1;
-			chip->V[register_index_x] >>= 1;
+	chip->V[instruction->x] -= chip->V[instruction->y];
+	next_opcode(chip);
+}
 
-			next_opcode(chip);
-			break;
-		}
-		case 0x0007: { // 0x8XY7: Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't
-			Uint8 register_index_x = (chip->opcode & 0x0F00) >> 8;
-			Uint8 register_index_y = (chip->opcode & 0x00F0) >> 4;
+void x_8xy6(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XY6: Shifts VX right by one. VF is set to the value of the least significant bit of VX before the shift
+	chip->V[0xF] = chip->V[instruction->x] & 0x1;
+	chip->V[instruction->x] >>= 1;
+	next_opcode(chip);
+}
 
-			if (chip->V[register_index_x] > chip->V[register_index_y])
-				chip->V[0xF] = 0; // There is a borrow
-			else
-				chip->V[0xF] = 1;
+void x_8xy6_vy(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XY6 on the COSMAC VIP, it shifted VY instead and stored the result in VX
+	uint8_t value = chip->V[instruction->y];
+	chip->V[0xF] = value & 0x1;
+	chip->V[instruction->x] = value >> 1;
+	next_opcode(chip);
+}
 
-			chip->V[register_index_x] = chip->V[register_index_y] - chip->V[register_index_x];
+void x_8xy7(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XY7: Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't
+	if (chip->V[instruction->x] > chip->V[instruction->y])
+		chip->V[0xF] = 0; // There is a borrow
+	else
+		chip->V[0xF] = 1;
 
-			next_opcode(chip);
-			break;
-		}
-		case 0x000E: { // 0x8XYE: Shifts VX left by one. VF is set to the value of the most significant bit of VX before the shift
-			Uint8 register_index_x = (chip->opcode & 0x0F00) >> 8;
+	chip->V[instruction->x] = chip->V[instruction->y] - chip->V[instruction->x];
+	next_opcode(chip);
+}
 
-			chip->V[0xF] = chip->V[register_index_x] >> 7;
-			chip->V[register_index_x] <<= 1;
+void x_8xye(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XYE: Shifts VX left by one. VF is set to the value of the most significant bit of VX before the shift
+	chip->V[0xF] = chip->V[instruction->x] >> 7;
+	chip->V[instruction->x] <<= 1;
+	next_opcode(chip);
+}
 
-			next_opcode(chip);
-			break;
-		}
-		default:
-			printf("Unsupported opcode: 0x%X\n", chip->opcode);
-	}
+void x_8xye_vy(Chip8* chip, const Instruction* instruction)
+{
+	// 0x8XYE on the COSMAC VIP, it shifted VY instead and stored the result in VX
+	uint8_t value = chip->V[instruction->y];
+	chip->V[0xF] = value >> 7;
+	chip->V[instruction->x] = value << 1;
+	next_opcode(chip);
 }
 
-void x_9(Chip8* chip)
+void x_9(Chip8* chip, const Instruction* instruction)
 {
 	// 0x9XY0: Skips the next instruction if VX doesn't equal VY
-	Uint8 register_index_x = (chip->opcode & 0x0F00) >> 8;
-	Uint8 register_index_y = (chip->opcode & 0x00F0) >> 4;
-	if (chip->V[register_index_x] != chip->V[register_index_y])
+	if (chip->V[instruction->x] != chip->V[instruction->y])
 		skip_next_opcode(chip);
 	else
 		next_opcode(chip);
 }
 
-void x_a(Chip8* chip)
+void x_a(Chip8* chip, const Instruction* instruction)
 {
 	// ANNN: Sets I to the address NNN
-	Uint16 nnn = chip->opcode & 0x0FFF;
-	chip->I = nnn;
+	chip->I = instruction->nnn;
 	next_opcode(chip);
 }
 
-void x_b(Chip8* chip)
+void x_b(Chip8* chip, const Instruction* instruction)
 {
 	// BNNN: Jumps to the address NNN plus V0
 	// We don't need to increment the program counter here since where jumping to a specified address
-	Uint16 nnn = chip->opcode & 0x0FFF;
-	chip->program_counter = nnn + chip->V[0];
+	// The address can be past the first 4 KB
+	chip->program_counter = instruction->nnn + chip->V[0];
+}
+
+void x_bxnn(Chip8* chip, const Instruction* instruction)
+{
+	// BXNN: SUPER-CHIP read BNNN as a jump to XNN plus VX
+	chip->program_counter = instruction->nnn + chip->V[instruction->x];
 }
 
-void x_c(Chip8* chip)
+void x_c(Chip8* chip, const Instruction* instruction)
 {
 	// CXNN: Sets VX to a random number, masked/"anded" by NN
-	// Seed the rand() function
-	srand(time(NULL));
-	// Get a random value between 0 and 255
-	Uint8 random_value = rand() % 0xFF;
-	Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-	Uint8 nn = chip->opcode & 0x00FF;
-	chip->V[register_index] = random_value & nn;
+	chip->V[instruction->x] = next_random(&chip->random_state) & instruction->nn;
 
 	next_opcode(chip);
 }
 
-void x_d(Chip8* chip)
+void x_d(Chip8* chip, const Instruction* instruction)
 {
 	// DXYN: Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels. 
 	// Each row of 8 pixels is read as bit-coded starting from memory location I; 
 	// I value doesn't change after the execution of this instruction. 
 	// VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, 
 	// and to 0 if that doesn't happen
+	// DXY0 draws a 16x16 sprite, SUPER-CHIP added it
+	chip->V[0xF] = draw_sprite(chip, chip->V[instruction->x], chip->V[instruction->y], chip->I, instruction->n);
+	chip->redraw = 1;
+	TRACE_DRAW(chip);
+	next_opcode(chip);
+}
 
-	// Credit: http://www.multigesture.net/wp-content/uploads/mirror/goldroad/chip8.shtml
+void x_d_clip(Chip8* chip, const Instruction* instruction)
+{
+	// DXYN with the sprite clipped at the edges of the display instead of wrapping around
+	chip->V[0xF] = clip_sprite(&chip->display_buffer, chip->memory, chip->V[instruction->x], chip->V[instruction->y], chip->I, instruction->n);
+	chip->redraw = 1;
+	TRACE_DRAW(chip);
+	next_opcode(chip);
+}
 
-	Uint8 register_index_x = (chip->opcode & 0x0F00) >> 8;
-	Uint8 register_index_y = (chip->opcode & 0x00F0) >> 4;
-	Uint16 x = chip->V[register_index_x];
-	Uint16 y = chip->V[register_index_y];
-	Uint16 height = chip->opcode & 0x000F;
-	Uint16 pixel;
+uint8_t draw_sprite(Chip8* chip, uint8_t x, uint8_t y, uint16_t address, uint8_t height)
+{
+	return blit_sprite(&chip->display_buffer, chip->memory, x, y, address, height);
+}
 
-	chip->V[0xF] = 0;
-	for (int yline = 0; yline < height; yline++)
+uint8_t blit_sprite(DisplayBuffer* display, const uint8_t* memory, uint8_t x, uint8_t y, uint16_t address, uint8_t height)
+{
+	/*
+	Draws the sprite at address into every selected plane. Pixels past the right edge wrap around to the left
+	and rows past the bottom wrap around to the top. A height of 0 draws a 16x16 sprite, two bytes per row.
+	Returns 1 if any pixel was turned off.
+	*/
+	return draw_planes(display, memory, x, y, address, height, 0);
+}
+
+uint8_t clip_sprite(DisplayBuffer* display, const uint8_t* memory, uint8_t x, uint8_t y, uint16_t address, uint8_t height)
+{
+	/*
+	blit_sprite() for interpreters that clip: the position still wraps around, but the pixels past the right edge
+	and the rows past the bottom of the display are dropped.
+	*/
+	return draw_planes(display, memory, x, y, address, height, 1);
+}
+
+uint8_t draw_planes(DisplayBuffer* display, const uint8_t* memory, uint8_t x, uint8_t y, uint16_t address, uint8_t height, uint8_t clip)
+{
+	// Every selected plane gets a sprite of its own, the sprite of the second plane follows the one of the first in memory
+	uint8_t collision = 0;
+	uint16_t size = height == 0 ? 32 : height;
+
+	for (uint8_t plane = 0; plane < CHIP8_PLANES; plane++)
 	{
-		pixel = chip->memory[chip->I + yline];
-		for (int xline = 0; xline < 8; xline++)
-		{
-			if ((pixel & (0x80 >> xline)) != 0)
-			{
-				if (chip->display_buffer[(x + xline + ((y + yline) * 64))] == 1)
-				{
-					chip->V[0xF] = 1;
-				}
-				chip->display_buffer[x + xline + ((y + yline) * 64)] ^= 1;
-			}
-		}
+		if ((display->plane_mask >> plane & 1) == 0)
+			continue;
+
+		if (display->hires)
+			collision |= draw_hires_sprite(display->planes[plane], memory, x, y, address, height, clip);
+		else
+			collision |= draw_lores_sprite(display->planes[plane], memory, x, y, address, height, clip);
+
+		address += size;
 	}
 
-	chip->redraw = 1;
-	next_opcode(chip);
+	return collision;
 }
 
-void x_e(Chip8* chip)
+uint8_t draw_lores_sprite(uint64_t rows[64][2], const uint8_t* memory, uint8_t x, uint8_t y, uint16_t address, uint8_t height, uint8_t clip)
 {
-	switch (chip->opcode & 0x00FF)
+	/*
+	Each low resolution row is one 64-bit word with the leftmost pixel in the most significant bit.
+	A sprite row is moved into place with a single rotate, or a shift when clipping,
+	and drawing it is one AND to detect a collision and one XOR.
+	*/
+	uint64_t collision = 0;
+	uint8_t wide = height == 0;
+	uint8_t count = wide ? 16 : height;
+	x &= 63;
+	y &= 31;
+
+	for (uint8_t row = 0; row < count; row++)
 	{
-		case 0x009E: { // EX9E: Skips the next instruction if the key stored in VX is pressed
-			Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-			Uint8 register_value = chip->V[register_index];
-			if (chip->key_state[register_value] != 0)
-				skip_next_opcode(chip);
-			else
-				next_opcode(chip);
+		if (clip && y + row >= 32)
 			break;
-		}
-		case 0x00A1: { // EXA1: Skips the next instruction if the key stored in VX isn't pressed
-			Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-			Uint8 register_value = chip->V[register_index];
-			if (chip->key_state[register_value] == 0)
-				skip_next_opcode(chip);
-			else
-				next_opcode(chip);
-			break;
-		}
-		default:
-			printf("Unsupported opcode: 0x%X\n", chip->opcode);
+
+		uint64_t bits = sprite_row(memory, address, row, wide);
+		bits = clip ? bits >> x : (bits >> x) | (bits << ((64 - x) & 63));
+
+		uint64_t* display_row = &rows[(y + row) & 31][0];
+		collision |= *display_row & bits;
+		*display_row ^= bits;
 	}
+
+	return collision != 0;
 }
 
-void x_f(Chip8* chip)
+uint8_t draw_hires_sprite(uint64_t rows[64][2], const uint8_t* memory, uint8_t x, uint8_t y, uint16_t address, uint8_t height, uint8_t clip)
 {
-	switch (chip->opcode & 0x00FF)
+	/*
+	A 128x64 row is two words. A sprite row at x lands in the word x is in and spills into the next one,
+	past the right edge the spill either wraps around into the left word or is dropped when clipping.
+	*/
+	uint64_t collision = 0;
+	uint8_t wide = height == 0;
+	uint8_t count = wide ? 16 : height;
+	uint8_t shift = x & 63;
+	uint8_t half = (x >> 6) & 1;
+	y &= 63;
+
+	for (uint8_t row = 0; row < count; row++)
 	{
-		case 0x0007: { // FX07: Sets VX to the value of the delay timer
-			Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-			chip->V[register_index] = chip->delay_timer;
-			next_opcode(chip);
+		if (clip && y + row >= 64)
 			break;
-		}
-		case 0x000A: { // FX0A: A key press is awaited, and then stored in VX		
-			Uint8 key_was_pressed = 0;
-			Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
 
-			for (Uint8 i = 0; i < 16; i++)
-			{
-				if (chip->key_state[i] != 0)
-				{
-					chip->V[register_index] = i;
-					key_was_pressed = 1;
-				}
-			}
+		uint64_t bits = sprite_row(memory, address, row, wide);
+		uint64_t spill = shift != 0 ? bits << (64 - shift) : 0;
+		uint64_t words[2];
+		words[half] = bits >> shift;
+		words[half ^ 1] = half == 1 && clip ? 0 : spill;
 
-			if (key_was_pressed == 0)
-				break;
-			
-			next_opcode(chip);
-			break;
-		}
-		case 0x0015: { // FX15: Sets the delay timer to VX
-			Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-			chip->delay_timer = chip->V[register_index];
-			next_opcode(chip);
-			break;
-		}
-		case 0x0018: { // FX18: Sets the sound timer to VX
-			Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-			chip->sound_timer = chip->V[register_index];
-			next_opcode(chip);
-			break;
+		uint64_t* display_row = rows[(y + row) & 63];
+		collision |= (display_row[0] & words[0]) | (display_row[1] & words[1]);
+		display_row[0] ^= words[0];
+		display_row[1] ^= words[1];
+	}
+
+	return collision != 0;
+}
+
+uint64_t sprite_row(const uint8_t* memory, uint16_t address, uint8_t row, uint8_t wide)
+{
+	// A row of a sprite in the top bits of a word, 8 pixels, or 16 for the 16x16 sprites of DXY0
+	if (wide)
+		return (uint64_t)memory[(uint16_t)(address + row * 2)] << 56 | (uint64_t)memory[(uint16_t)(address + row * 2 + 1)] << 48;
+
+	return (uint64_t)memory[(uint16_t)(address + row)] << 56;
+}
+
+void clear_display(DisplayBuffer* display)
+{
+	// Clears the selected planes
+	for (int plane = 0; plane < CHIP8_PLANES; plane++)
+	{
+		if (display->plane_mask >> plane & 1)
+			memset(display->planes[plane], 0, sizeof(display->planes[plane]));
+	}
+}
+
+void scroll_down(DisplayBuffer* display, uint8_t lines)
+{
+	// Rows move down as a whole, the rows that come in at the top are blank. Low resolution scrolls by its own, bigger pixels
+	int height = display->hires ? 64 : 32;
+	if (lines > height)
+		lines = (uint8_t)height;
+
+	for (int plane = 0; plane < CHIP8_PLANES; plane++)
+	{
+		if ((display->plane_mask >> plane & 1) == 0)
+			continue;
+
+		uint64_t (*rows)[2] = display->planes[plane];
+		memmove(rows[lines], rows[0], sizeof(rows[0]) * (height - lines));
+		memset(rows[0], 0, sizeof(rows[0]) * lines);
+	}
+}
+
+void scroll_up(DisplayBuffer* display, uint8_t lines)
+{
+	// The rows that come in at the bottom are blank
+	int height = display->hires ? 64 : 32;
+	if (lines > height)
+		lines = (uint8_t)height;
+
+	for (int plane = 0; plane < CHIP8_PLANES; plane++)
+	{
+		if ((display->plane_mask >> plane & 1) == 0)
+			continue;
+
+		uint64_t (*rows)[2] = display->planes[plane];
+		memmove(rows[0], rows[lines], sizeof(rows[0]) * (height - lines));
+		memset(rows[height - lines], 0, sizeof(rows[0]) * lines);
+	}
+}
+
+void scroll_right(DisplayBuffer* display)
+{
+	// Moves every row 4 pixels to the right, a 128-bit row is shifted across its two words
+	for (int plane = 0; plane < CHIP8_PLANES; plane++)
+	{
+		if ((display->plane_mask >> plane & 1) == 0)
+			continue;
+
+		uint64_t (*rows)[2] = display->planes[plane];
+		if (display->hires == 0)
+		{
+			for (int y = 0; y < 32; y++)
+				rows[y][0] >>= 4;
+			continue;
 		}
-		case 0x001E: { // FX1E: Adds VX to I
-			Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-			// VF is set to 1 when range overflow(I + VX > 0xFFF), and 0 when there isn't.
-			// This is undocumented feature of the CHIP-8 and used by Spacefight 2091! game.
-			if (chip->I + chip->V[register_index] > 0xFFF)	
-				chip->V[0xF] = 1;
-			else
-				chip->V[0xF] = 0;
-
-			chip->I += chip->V[register_index];
-			next_opcode(chip);
-			break;
+
+		for (int y = 0; y < 64; y++)
+		{
+			rows[y][1] = rows[y][1] >> 4 | rows[y][0] << 60;
+			rows[y][0] >>= 4;
 		}
-		case 0x0029: { // FX29: Sets I to the location of the sprite for the character in VX. Characters 0-F (in hexadecimal) are represented by a 4x5 font
-			Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-			chip->I = chip->V[register_index] * 5;
-			next_opcode(chip);
-			break;
+	}
+}
+
+void scroll_left(DisplayBuffer* display)
+{
+	// Moves every row 4 pixels to the left
+	for (int plane = 0; plane < CHIP8_PLANES; plane++)
+	{
+		if ((display->plane_mask >> plane & 1) == 0)
+			continue;
+
+		uint64_t (*rows)[2] = display->planes[plane];
+		if (display->hires == 0)
+		{
+			for (int y = 0; y < 32; y++)
+				rows[y][0] <<= 4;
+			continue;
 		}
-		case 0x0033: { // FX33: Stores the Binary-coded decimal representation of VX at the addresses I, I plus 1, and I plus 2
-			// Credit: http://www.multigesture.net/wp-content/uploads/mirror/goldroad/chip8.shtml
-			Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-
-			chip->memory[chip->I] = chip->V[register_index] / 100;
-			chip->memory[chip->I + 1] = (chip->V[register_index] / 10) % 10;
-			chip->memory[chip->I + 2] = (chip->V[register_index] % 100) % 10;
-			next_opcode(chip);
-			break;
+
+		for (int y = 0; y < 64; y++)
+		{
+			rows[y][0] = rows[y][0] << 4 | rows[y][1] >> 60;
+			rows[y][1] <<= 4;
 		}
-		case 0x0055: { // FX55: Stores V0 to VX in memory starting at address I					
-			Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-			for (Uint8 i = 0; i <= register_index; i++)
-				chip->memory[chip->I + i] = chip->V[i];
+	}
+}
 
-			// On the original interpreter, when the operation is done, I = I + X + 1. On current implementations, I is left unchanged.
-			// Include this?
-			//chip->I += register_index + 1;
+void set_resolution(DisplayBuffer* display, uint8_t hires)
+{
+	// The two modes keep their pixels in different places, switching clears every plane
+	memset(display->planes, 0, sizeof(display->planes));
+	display->hires = hires;
+}
 
-			next_opcode(chip);
-			break;
-		}
-		case 0x0065: { // FX65: Fills V0 to VX with values from memory starting at address I
-			Uint8 register_index = (chip->opcode & 0x0F00) >> 8;
-			for (Uint8 i = 0; i <= register_index; i++)
-				chip->V[i] = chip->memory[chip->I + i];
+void set_quirk_profile(Chip8* chip, QuirkProfile profile)
+{
+	// Instructions decoded and blocks compiled for another profile would keep its behaviour
+	chip->quirks = (uint8_t)profile;
+	flush_decoded(chip);
+	if (chip->jit != NULL)
+		jit_flush(chip);
+}
 
-			// On the original interpreter, when the operation is done, I = I + X + 1. On current implementations, I is left unchanged.
-			// Include this?
-			//chip->I += register_index + 1;
+int find_quirk_profile(const char* name)
+{
+	// Returns the QuirkProfile called name, or -1
+	for (int profile = 0; profile < QUIRKS_COUNT; profile++)
+	{
+		if (strcmp(quirk_profile_names[profile], name) == 0)
+			return profile;
+	}
 
-			next_opcode(chip);
-			break;
-		}
-		default:
-			printf("Unsupported opcode: 0x%X\n", chip->opcode);
+	return -1;
+}
+
+void x_ex9e(Chip8* chip, const Instruction* instruction)
+{
+	// EX9E: Skips the next instruction if the key stored in VX is pressed
+	uint8_t register_value = chip->V[instruction->x] & 0xF;
+	TRACE_KEY_READ(chip, 1 << register_value, chip->cycles);
+	if (chip->keys >> register_value & 1)
+		skip_next_opcode(chip);
+	else
+		next_opcode(chip);
+}
+
+void x_exa1(Chip8* chip, const Instruction* instruction)
+{
+	// EXA1: Skips the next instruction if the key stored in VX isn't pressed
+	uint8_t register_value = chip->V[instruction->x] & 0xF;
+	TRACE_KEY_READ(chip, 1 << register_value, chip->cycles);
+	if ((chip->keys >> register_value & 1) == 0)
+		skip_next_opcode(chip);
+	else
+		next_opcode(chip);
+}
+
+void x_f000(Chip8* chip, const Instruction* instruction)
+{
+	// F000 NNNN: Sets I to the 16-bit address NNNN in the next two bytes, XO-CHIP's way to reach all of memory
+	uint16_t address = chip->program_counter + 2;
+	chip->I = chip->memory[address] << 8 | chip->memory[(uint16_t)(address + 1)];
+	chip->program_counter += 4;
+}
+
+void x_fn01(Chip8* chip, const Instruction* instruction)
+{
+	// FN01: Selects the planes in the bits of N for drawing, scrolling and clearing
+	chip->display_buffer.plane_mask = instruction->x & ((1 << CHIP8_PLANES) - 1);
+	next_opcode(chip);
+}
+
+void x_f002(Chip8* chip, const Instruction* instruction)
+{
+	// F002: Loads the 16 bytes at I into the audio pattern, I is left as it is
+	for (int i = 0; i < 16; i++)
+		chip->audio_pattern[i] = chip->memory[(uint16_t)(chip->I + i)];
+
+	next_opcode(chip);
+}
+
+void x_fx07(Chip8* chip, const Instruction* instruction)
+{
+	// FX07: Sets VX to the value of the delay timer
+	chip->V[instruction->x] = chip->delay_timer;
+	next_opcode(chip);
+}
+
+void x_fx0a(Chip8* chip, const Instruction* instruction)
+{
+	// FX0A: A key press is awaited, and then stored in VX
+	if (chip->keys == 0)
+		return;
+
+	TRACE_KEY_READ(chip, chip->keys, chip->cycles);
+	chip->V[instruction->x] = highest_key(chip->keys);
+	next_opcode(chip);
+}
+
+void x_fx15(Chip8* chip, const Instruction* instruction)
+{
+	// FX15: Sets the delay timer to VX
+	chip->delay_timer = chip->V[instruction->x];
+	next_opcode(chip);
+}
+
+void x_fx18(Chip8* chip, const Instruction* instruction)
+{
+	// FX18: Sets the sound timer to VX
+	chip->sound_timer = chip->V[instruction->x];
+	next_opcode(chip);
+}
+
+void x_fx1e(Chip8* chip, const Instruction* instruction)
+{
+	// FX1E: Adds VX to I
+	// VF is set to 1 when range overflow(I + VX > 0xFFF), and 0 when there isn't.
+	// This is undocumented feature of the CHIP-8 and used by Spacefight 2091! game.
+	if (chip->I + chip->V[instruction->x] > 0xFFF)	
+		chip->V[0xF] = 1;
+	else
+		chip->V[0xF] = 0;
+
+	chip->I += chip->V[instruction->x];
+	next_opcode(chip);
+}
+
+void x_fx29(Chip8* chip, const Instruction* instruction)
+{
+	// FX29: Sets I to the location of the sprite for the character in VX. Characters 0-F (in hexadecimal) are represented by a 4x5 font
+	chip->I = chip->V[instruction->x] * 5;
+	next_opcode(chip);
+}
+
+void x_fx30(Chip8* chip, const Instruction* instruction)
+{
+	// FX30: Sets I to the location of the 8x10 sprite for the character in VX
+	chip->I = CHIP8_BIG_FONT_ADDRESS + (chip->V[instruction->x] & 0xF) * 10;
+	next_opcode(chip);
+}
+
+void x_fx33(Chip8* chip, const Instruction* instruction)
+{
+	// FX33: Stores the Binary-coded decimal representation of VX at the addresses I, I plus 1, and I plus 2
+	// Credit: http://www.multigesture.net/wp-content/uploads/mirror/goldroad/chip8.shtml
+	uint8_t register_value = chip->V[instruction->x];
+
+	chip->memory[chip->I] = register_value / 100;
+	chip->memory[(uint16_t)(chip->I + 1)] = (register_value / 10) % 10;
+	chip->memory[(uint16_t)(chip->I + 2)] = (register_value % 100) % 10;
+
+	for (uint8_t i = 0; i < 3; i++)
+		invalidate_code(chip, (uint16_t)(chip->I + i));
+
+	next_opcode(chip);
+}
+
+void x_fx3a(Chip8* chip, const Instruction* instruction)
+{
+	// FX3A: Sets the pitch of the audio pattern to VX
+	chip->pitch = chip->V[instruction->x];
+	next_opcode(chip);
+}
+
+void x_fx55(Chip8* chip, const Instruction* instruction)
+{
+	// FX55: Stores V0 to VX in memory starting at address I
+	for (uint8_t i = 0; i <= instruction->x; i++)
+	{
+		uint16_t address = (uint16_t)(chip->I + i);
+		chip->memory[address] = chip->V[i];
+		invalidate_code(chip, address);
 	}
+
+	next_opcode(chip);
+}
+
+void x_fx55_i(Chip8* chip, const Instruction* instruction)
+{
+	// FX55 on the original interpreter, when the operation is done, I = I + X + 1. On current implementations, I is left unchanged.
+	x_fx55(chip, instruction);
+	chip->I += instruction->x + 1;
+}
+
+void x_fx65(Chip8* chip, const Instruction* instruction)
+{
+	// FX65: Fills V0 to VX with values from memory starting at address I
+	for (uint8_t i = 0; i <= instruction->x; i++)
+		chip->V[i] = chip->memory[(uint16_t)(chip->I + i)];
+
+	next_opcode(chip);
+}
+
+void x_fx65_i(Chip8* chip, const Instruction* instruction)
+{
+	// FX65 on the original interpreter, I is left at I + X + 1 like with FX55
+	x_fx65(chip, instruction);
+	chip->I += instruction->x + 1;
+}
+
+void x_fx75(Chip8* chip, const Instruction* instruction)
+{
+	// FX75: Stores V0 to VX in the user flags
+	memcpy(chip->flags, chip->V, instruction->x + 1);
+	next_opcode(chip);
+}
+
+void x_fx85(Chip8* chip, const Instruction* instruction)
+{
+	// FX85: Fills V0 to VX with the user flags
+	memcpy(chip->V, chip->flags, instruction->x + 1);
+	next_opcode(chip);
+}
+
+void x_unsupported(Chip8* chip, const Instruction* instruction)
+{
+	printf("Unsupported opcode: 0x%X\n", instruction->opcode);
 }
 
 void fetch_opcode(Chip8* chip)
 {
 	// Each opcode is 2 bytes long so we need to grab them from the memory byte by byte and then merge them together
-	chip->opcode = chip->memory[chip->program_counter] << 8 | chip->memory[chip->program_counter + 1];
+	uint16_t address = chip->program_counter;
+	chip->opcode = chip->memory[address] << 8 | chip->memory[(uint16_t)(address + 1)];
 
 	//printf("Opcode: 0x%X\n", chip->opcode);
 }
 
 void stack_push(Chip8* chip)
 {
-	if (chip->stack_pointer == 15)
+	// A call past the 16 levels isn't stored, the return from it goes back to an older caller
+	if (chip->stack_pointer == 16)
+	{
 		printf("Stack overflow!");
+		return;
+	}
 
 	chip->stack[chip->stack_pointer] = chip->program_counter;	// Pu the current address on the stack
 	chip->stack_pointer++;										// Increment the stack pointer
@@ -493,8 +1250,12 @@ void stack_push(Chip8* chip)
 
 void stack_pop(Chip8* chip)
 {
+	// A return with nothing on the stack goes on with the next instruction
 	if (chip->stack_pointer == 0)
+	{
 		printf("Stack underflow!");
+		return;
+	}
 
 	chip->stack_pointer--;
 	chip->program_counter = chip->stack[chip->stack_pointer];	// Set the address on the stack as the program counter
@@ -514,32 +1275,63 @@ Chip8* create_chip()
 	chip->I = 0;
 	chip->stack_pointer = 0;
 
-	for (int i = 0; i < 2048; i++)
-		chip->display_buffer[i] = 0;
+	memset(&chip->display_buffer, 0, sizeof(chip->display_buffer));
+	chip->display_buffer.plane_mask = 1;
+	memset(chip->flags, 0, sizeof(chip->flags));
 
 	for (int i = 0; i < 16; i++)
 		chip->stack[i] = 0;
 
 	for (int i = 0; i < 16; i++)
-		chip->key_state[i] = chip->V[i] = 0;
+		chip->V[i] = 0;
+
+	chip->keys = 0;
 
-	for (int i = 0; i < 4096; i++)
-		chip->memory[i] = 0;
+	memset(chip->memory, 0, sizeof(chip->memory));
 
 	for (int i = 0; i < 80; i++)
 		chip->memory[i] = fontset[i];
 
+	memcpy(&chip->memory[CHIP8_BIG_FONT_ADDRESS], big_fontset, sizeof(big_fontset));
+
+	memcpy(chip->loaded_memory, chip->memory, sizeof(chip->memory));
+	chip->rom_hash = hash_bytes(chip->memory, 4096);
+	memset(chip->dirty_pages, 0, sizeof(chip->dirty_pages));
+
+	// Nothing has been decoded yet
+	for (int page = 0; page < CHIP8_CODE_PAGES; page++)
+		chip->code_pages[page] = empty_code_page;
+	chip->jit = NULL;
+	chip->quirks = QUIRKS_MODERN;
+	chip->trace_state = TRACE_OFF;
+	chip->trace_keys = 0;
+	chip->trace_cycle = 0;
+
 	// Reset timers
 	chip->delay_timer = 0;
 	chip->sound_timer = 0;
+	memset(chip->audio_pattern, CHIP8_DEFAULT_AUDIO_PATTERN, sizeof(chip->audio_pattern));
+	chip->pitch = CHIP8_DEFAULT_PITCH;
+	chip->cycles_per_frame = 10;		// 600 instructions per second
+	chip->frame_cycles = 0;
+	seed_chip(chip, CHIP8_DEFAULT_SEED);
 
 	chip->redraw = 1;
+	chip->cycles = 0;
 
 	return chip;
 }
 
 void destroy_chip(Chip8* chip)
 {
+	destroy_jit(chip);
+
+	for (int page = 0; page < CHIP8_CODE_PAGES; page++)
+	{
+		if (chip->code_pages[page] != empty_code_page)
+			free(chip->code_pages[page]);
+	}
+
 	free(chip);
 }
 
@@ -550,172 +1342,151 @@ void next_opcode(Chip8* chip)
 
 void skip_next_opcode(Chip8* chip)
 {
-	chip->program_counter += 4;
+	chip->program_counter += CHIP8_SKIP_LENGTH(chip->memory, chip->program_counter);
+}
+
+void set_key(Chip8* chip, uint8_t key, uint8_t down)
+{
+	// Presses or releases key 0 to F, the host maps its own input to these
+	if (down)
+		chip->keys |= 1 << (key & 0xF);
+	else
+		chip->keys &= ~(1 << (key & 0xF));
+}
+
+uint8_t highest_key(uint16_t keys)
+{
+	// The highest of the keys that are down, keys can't be 0. FX0A has always taken the highest when several are down
+#if defined(__GNUC__) || defined(__clang__)
+	return (uint8_t)(31 - __builtin_clz(keys));
+#elif defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse(&index, keys);
+	return (uint8_t)index;
+#else
+	uint8_t key = 15;
+	while ((keys >> key & 1) == 0)
+		key--;
+	return key;
+#endif
+}
+
+void seed_chip(Chip8* chip, uint32_t seed)
+{
+	// Two chips with the same seed, ROM and keys run exactly the same
+	chip->random_state = seed_random(seed);
 }
 
-void handle_event(SDL_Event e, Chip8* chip)
+uint32_t seed_random(uint32_t seed)
 {
-	// A key was pushed
-	if (e.type == SDL_KEYDOWN && e.key.repeat == 0)
+	// xorshift32 gets stuck at 0, every other seed is used as it is
+	return seed != 0 ? seed : CHIP8_DEFAULT_SEED;
+}
+
+uint8_t next_random(uint32_t* state)
+{
+	// xorshift32, the high byte is the most random one
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return (uint8_t)(x >> 24);
+}
+
+uint64_t display_hash(const Chip8* chip)
+{
+	/*
+	64-bit FNV-1a of the display rows, most significant byte first so the hash is the same on every host.
+	Low resolution only hashes the 32 words it uses. The second plane is only hashed when something is drawn on it,
+	so ROMs that never select it hash the same as before there were planes.
+	*/
+	const DisplayBuffer* display = &chip->display_buffer;
+	int height = display->hires ? 64 : 32;
+	int words = display->hires ? 2 : 1;
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (int plane = 0; plane < CHIP8_PLANES; plane++)
 	{
-		switch (e.key.keysym.sym)
+		uint64_t used = plane == 0;
+		for (int y = 0; y < height && used == 0; y++)
+			used = display->planes[plane][y][0] | display->planes[plane][y][1];
+
+		if (used == 0)
+			continue;
+
+		for (int y = 0; y < height; y++)
 		{
-			case SDLK_1:
-				chip->key_state[0] = 1;
-				break;
-			case SDLK_2:
-				chip->key_state[1] = 1;
-				break;
-			case SDLK_3:
-				chip->key_state[2] = 1;
-				break;
-			case SDLK_4:
-				chip->key_state[3] = 1;
-				break;
-			case SDLK_5:
-				chip->key_state[4] = 1;
-				break;
-			case SDLK_6:
-				chip->key_state[5] = 1;
-				break;
-			case SDLK_7:
-				chip->key_state[6] = 1;
-				break;
-			case SDLK_8:
-				chip->key_state[7] = 1;
-				break;
-			case SDLK_q:
-				chip->key_state[8] = 1;
-				break;
-			case SDLK_w:
-				chip->key_state[9] = 1;
-				break;
-			case SDLK_e:
-				chip->key_state[10] = 1;
-				break;
-			case SDLK_r:
-				chip->key_state[11] = 1;
-				break;
-			case SDLK_t:
-				chip->key_state[12] = 1;
-				break;
-			case SDLK_y:
-				chip->key_state[13] = 1;
-				break;
-			case SDLK_u:
-				chip->key_state[14] = 1;
-				break;
-			case SDLK_i:
-				chip->key_state[15] = 1;
-				break;
-			default:
-				break;
+			for (int word = 0; word < words; word++)
+			{
+				for (int shift = 56; shift >= 0; shift -= 8)
+				{
+					hash ^= (display->planes[plane][y][word] >> shift) & 0xFF;
+					hash *= 1099511628211ULL;
+				}
+			}
 		}
 	}
 
-	// A key was released
-	else if (e.type == SDL_KEYUP && e.key.repeat == 0)
+	return hash;
+}
+
+uint64_t hash_bytes(const uint8_t* data, size_t size)
+{
+	// 64-bit FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < size; i++)
 	{
-		switch (e.key.keysym.sym)
-		{
-			case SDLK_1:
-				chip->key_state[0] = 0;
-				break;
-			case SDLK_2:
-				chip->key_state[1] = 0;
-				break;
-			case SDLK_3:
-				chip->key_state[2] = 0;
-				break;
-			case SDLK_4:
-				chip->key_state[3] = 0;
-				break;
-			case SDLK_5:
-				chip->key_state[4] = 0;
-				break;
-			case SDLK_6:
-				chip->key_state[5] = 0;
-				break;
-			case SDLK_7:
-				chip->key_state[6] = 0;
-				break;
-			case SDLK_8:
-				chip->key_state[7] = 0;
-				break;
-			case SDLK_q:
-				chip->key_state[8] = 0;
-				break;
-			case SDLK_w:
-				chip->key_state[9] = 0;
-				break;
-			case SDLK_e:
-				chip->key_state[10] = 0;
-				break;
-			case SDLK_r:
-				chip->key_state[11] = 0;
-				break;
-			case SDLK_t:
-				chip->key_state[12] = 0;
-				break;
-			case SDLK_y:
-				chip->key_state[13] = 0;
-				break;
-			case SDLK_u:
-				chip->key_state[14] = 0;
-				break;
-			case SDLK_i:
-				chip->key_state[15] = 0;
-				break;
-			default:
-				break;
-		}
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
 	}
+
+	return hash;
 }
 
 int load_rom(Chip8* chip, const char* filename)
 {
-	FILE* pFile = fopen(filename, "rb");
-	if (pFile == NULL)
-	{
-		fputs("Could not open file \n", stderr);
+	// The file is mapped rather than read, load_program() copies the ROM straight out of the page cache
+	MappedFile file;
+	if (map_file(&file, filename) != 0)
 		return 1;
-	}
 
-	// Check file size
-	fseek(pFile, 0, SEEK_END);
-	long file_size = ftell(pFile);
-	rewind(pFile);
-	printf("Loading ROM: %s \nFilesize: %d \n", filename, (int)file_size);
+	printf("Loading ROM: %s \nFilesize: %d \n", filename, (int)file.size);
 
-	// Allocate memory to contain the whole file
-	char* file_buffer = (char*)malloc(sizeof(char) * file_size);
-	if (file_buffer == NULL)
-	{
-		fputs("Could not create the file buffer \n", stderr);
-		return 1;
-	}
+	int status = load_program(chip, file.data, file.size);
+	unmap_file(&file);
+
+	if (status != 0)
+		return status;
 
-	// Copy the file to the file buffer
-	size_t result = fread(file_buffer, 1, file_size, pFile);
-	if (result != file_size)
+	printf("ROM successfully loaded \n");
+
+	return 0;
+}
+
+int load_program(Chip8* chip, const uint8_t* program, size_t size)
+{
+	// Copies a ROM image that is already in memory to 0x200, hosts running many instances of a ROM read it once and load it with this
+	if (size > CHIP8_MEMORY_SIZE - 512)
 	{
-		fputs("The ROM did not load correctly \n", stderr);
+		printf("The ROM can not be larger then %d bytes \n", CHIP8_MEMORY_SIZE - 512);
 		return 1;
 	}
 
-	// Copy the file buffer into the memory array
-	if ((4096 - 512) > file_size)
-	{
-		for (int i = 0; i < file_size; ++i)
-			chip->memory[i + 512] = file_buffer[i];
-	}
-	else
-		printf("The ROM can not be larger then 4096 bytes \n");
+	memcpy(&chip->memory[512], program, size);
 
-	fclose(pFile);
-	free(file_buffer);
+	// Save states only store the pages that differ from this
+	memcpy(chip->loaded_memory, chip->memory, sizeof(chip->memory));
+	memset(chip->dirty_pages, 0, sizeof(chip->dirty_pages));
 
-	printf("ROM successfully loaded \n");
+	// Up to the end of the ROM but at least the first 4 KB, CHIP-8 ROMs hash like they did when there were only 4 KB of memory
+	chip->rom_hash = hash_bytes(chip->memory, 512 + size > 4096 ? 512 + size : 4096);
+
+	// The whole program area was rewritten, drop everything decoded from it
+	flush_decoded(chip);
+	if (chip->jit != NULL)
+		jit_flush(chip);
 
 	return 0;
 }
\ No newline at end of file
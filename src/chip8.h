@@ -1,31 +1,212 @@
 #ifndef CHIP8_H
 #define CHIP8_H
 
-#include <SDL.h>
+// The seed create_chip() starts with, runs are only different from each other when they are seeded differently
+#define CHIP8_DEFAULT_SEED 0x2545F491
 
-typedef struct {
-	Uint8 display_buffer[64 * 32];	// W * H, 2048 pixels
-	Uint8 key_state[16];			// 16 keys, 0 to F
+#include <stddef.h>
+#include <stdint.h>
+
+struct Chip8;
+struct Instruction;
+typedef struct Chip8Jit Chip8Jit;
+
+// Where FX30 finds the 8x10 digits of the SUPER-CHIP font, right after the 4x5 digits at 0
+#define CHIP8_BIG_FONT_ADDRESS 0x50
+
+// XO-CHIP memory, CHIP-8 and SUPER-CHIP ROMs only use the first 4 KB of it
+#define CHIP8_MEMORY_SIZE 0x10000
+#define CHIP8_MEMORY_MASK 0xFFFF
+
+// Save states and the lanes track writes to memory in pages of 64 bytes
+#define CHIP8_PAGE_SIZE 64
+#define CHIP8_PAGES (CHIP8_MEMORY_SIZE / CHIP8_PAGE_SIZE)
+
+// The decode cache is allocated in pages of 256 bytes of memory, 128 instructions, the first time code in them runs
+#define CHIP8_CODE_PAGE_SIZE 256
+#define CHIP8_CODE_PAGES (CHIP8_MEMORY_SIZE / CHIP8_CODE_PAGE_SIZE)
+
+// XO-CHIP bitplanes, a pixel's color is the bit of the first plane plus twice the bit of the second
+#define CHIP8_PLANES 2
+
+/*
+XO-CHIP plays the 128 one bit samples of the audio pattern, most significant bit first, at 4000 * 2 ^ ((pitch - 64) / 48)
+samples per second while the sound timer isn't 0. CHIP-8 and SUPER-CHIP ROMs never change the pattern and get a 500 Hz square wave.
+*/
+#define CHIP8_DEFAULT_PITCH 64
+#define CHIP8_DEFAULT_AUDIO_PATTERN 0xF0
+
+// How far a skip moves the program counter, F000 NNNN is the only instruction that is 4 bytes long
+#define CHIP8_SKIP_LENGTH(memory, pc) ((memory)[(uint16_t)((pc) + 2)] == 0xF0 && (memory)[(uint16_t)((pc) + 3)] == 0x00 ? 6 : 4)
+
+// Every distinct opcode form, in the order of the handlers in chip8.c
+typedef enum {
+	OP_UNSUPPORTED,
+	OP_00E0, OP_00EE, OP_00CN, OP_00DN, OP_00FB, OP_00FC, OP_00FD, OP_00FE, OP_00FF, OP_1NNN, OP_2NNN, OP_3XNN, OP_4XNN, OP_5XY0, OP_5XY2, OP_5XY3, OP_6XNN, OP_7XNN,
+	OP_8XY0, OP_8XY1, OP_8XY2, OP_8XY3, OP_8XY4, OP_8XY5, OP_8XY6, OP_8XY7, OP_8XYE,
+	OP_9XY0, OP_ANNN, OP_BNNN, OP_CXNN, OP_DXYN, OP_EX9E, OP_EXA1,
+	OP_F000, OP_FN01, OP_F002, OP_FX07, OP_FX0A, OP_FX15, OP_FX18, OP_FX1E, OP_FX29, OP_FX30, OP_FX33, OP_FX3A, OP_FX55, OP_FX65, OP_FX75, OP_FX85,
+	OP_COUNT
+} OpcodeForm;
+
+// Why emulate_cycles() returned
+typedef enum {
+	EXIT_BUDGET_EXHAUSTED,			// The requested number of instructions ran, or the frame is complete
+	EXIT_FRAME_DRAWN,				// 00E0, DXYN, a scroll or a change of resolution changed the display
+	EXIT_WAITING_FOR_KEY,			// FX0A found no pressed key, PC still points at it
+	EXIT_UNSUPPORTED_OPCODE,		// PC still points at the unsupported opcode
+	EXIT_IDLE						// PC is in a loop that can't end before the timers tick, see idle_loop()
+} ExitReason;
+
+// Behaviour that differs between CHIP-8 interpreters, a quirk profile is a combination of these
+#define QUIRK_LOAD_STORE_I 0x01		// FX55 and FX65 leave I at I + X + 1
+#define QUIRK_SHIFT_VY 0x02			// 8XY6 and 8XYE shift VY and store the result in VX
+#define QUIRK_LOGIC_VF_RESET 0x04	// 8XY1, 8XY2 and 8XY3 set VF to 0
+#define QUIRK_CLIP_SPRITES 0x08		// Sprites are clipped at the edges of the display instead of wrapping around
+#define QUIRK_JUMP_VX 0x10			// BXNN jumps to XNN plus VX instead of NNN plus V0
+
+#define QUIRKS_MODERN_FLAGS 0
+#define QUIRKS_COSMAC_FLAGS (QUIRK_LOAD_STORE_I | QUIRK_SHIFT_VY | QUIRK_LOGIC_VF_RESET | QUIRK_CLIP_SPRITES)
+#define QUIRKS_SCHIP_FLAGS (QUIRK_CLIP_SPRITES | QUIRK_JUMP_VX)
+#define QUIRKS_XOCHIP_FLAGS (QUIRK_LOAD_STORE_I | QUIRK_SHIFT_VY)
+
+// Every profile has a specialised interpreter loop, see chip8_core.h
+typedef enum {
+	QUIRKS_MODERN,					// What current interpreters and Chippy have always done, none of the quirks
+	QUIRKS_COSMAC,					// The original COSMAC VIP interpreter
+	QUIRKS_SCHIP,					// SUPER-CHIP 1.1 on the HP 48
+	QUIRKS_XOCHIP,					// XO-CHIP as Octo runs it
+	QUIRKS_COUNT
+} QuirkProfile;
+
+// Loops idle_loop() recognises
+typedef enum {
+	IDLE_NONE,
+	IDLE_JUMP,						// 1NNN jumping to itself
+	IDLE_DELAY_POLL,				// FX07, 3X00, 1NNN back to the FX07 while the delay timer isn't 0
+	IDLE_KEY_WAIT,					// FX0A while no key is down
+	IDLE_EXIT						// 00FD, the ROM exited and the chip stays on it
+} IdleLoop;
+
+// How far the trace of a key press has come, the host starts and finishes traces, the core only moves them along
+typedef enum {
+	TRACE_OFF,
+	TRACE_WAITING_FOR_READ,			// One of trace_keys went down and the ROM hasn't read it yet
+	TRACE_WAITING_FOR_DRAW,			// EX9E, EXA1 or FX0A read it at trace_cycle, no DXYN since
+	TRACE_DRAWN						// DXYN drew after the read, the frame the draw is in still has to be presented
+} TraceState;
+
+// EX9E, EXA1 and FX0A note the first read of a traced key and DXYN the first draw after it, one compare when nothing is traced
+#define TRACE_KEY_READ(chip, read_keys, cycle) \
+	if ((chip)->trace_state == TRACE_WAITING_FOR_READ && ((chip)->trace_keys & (read_keys)) != 0) \
+	{ \
+		(chip)->trace_state = TRACE_WAITING_FOR_DRAW; \
+		(chip)->trace_cycle = (cycle); \
+	}
+
+#define TRACE_DRAW(chip) \
+	if ((chip)->trace_state == TRACE_WAITING_FOR_DRAW) \
+		(chip)->trace_state = TRACE_DRAWN
+
+// A decoded opcode, cached per even address so emulate() only has to decode each instruction once
+typedef struct Instruction {
+	void (*handler)(struct Chip8*, const struct Instruction*);	// NULL until the slot has been decoded
+	uint16_t opcode;				// Raw opcode
+	uint16_t nnn;					// Lowest 12 bits, address
+	uint8_t x;						// Register index X
+	uint8_t y;						// Register index Y
+	uint8_t n;						// Lowest 4 bits
+	uint8_t nn;						// Lowest 8 bits
+	uint8_t form;					// OpcodeForm, used by the threaded core
+} Instruction;
+
+/*
+One bit per pixel, the leftmost pixel of a row in the most significant bit of planes[plane][y][0].
+A row of the 128x64 SUPER-CHIP mode is 128 bits, so a scroll moves whole words. The 64x32 mode only uses the left halves
+of the first 32 rows, so a low resolution row is still one 64-bit word, exactly like it was before there was a second mode.
+Drawing, scrolling and clearing only change the planes FN01 selected, CHIP-8 and SUPER-CHIP ROMs only ever use the first.
+*/
+typedef struct DisplayBuffer {
+	uint64_t planes[CHIP8_PLANES][64][2];
+	uint8_t hires;					// 1 after 00FF, 0 after 00FE and at power on
+	uint8_t plane_mask;				// Bit N is set when plane N is selected, 1 at power on
+} DisplayBuffer;
+
+typedef struct Chip8 {
+	DisplayBuffer display_buffer;
+	uint16_t keys;					// Bit N is set while key N is down, see set_key()
 											
-	Uint16 program_counter;			// Program counter
-	Uint16 opcode;					// Current opcode
-	Uint16 I;						// Address register
-	Uint16 stack_pointer;			// Stack pointer
+	uint16_t program_counter;		// Program counter
+	uint16_t opcode;				// Current opcode
+	uint16_t I;						// Address register
+	uint16_t stack_pointer;			// Stack pointer
 											
-	Uint8 V[16];					// 16 8-bit registers, V0 to VF
-	Uint16 stack[16];
-	Uint8 memory[4096];			
+	uint8_t V[16];					// 16 8-bit registers, V0 to VF
+	uint16_t stack[16];
+	uint8_t memory[CHIP8_MEMORY_SIZE];
 											
-	Uint8 delay_timer;				// Delay timer
-	Uint8 sound_timer;				// Sound timer
-	Uint8 redraw;
+	uint8_t delay_timer;			// Delay timer
+	uint8_t sound_timer;			// Sound timer
+	uint8_t audio_pattern[16];		// F002 loads it from memory
+	uint8_t pitch;					// FX3A sets it, see CHIP8_DEFAULT_PITCH
+	uint8_t redraw;
+	uint64_t cycles;				// Instructions executed since create_chip()
+	uint32_t cycles_per_frame;		// Instructions per 1/60 s of emulated time
+	uint32_t frame_cycles;			// Instructions executed in the current frame
+	uint32_t random_state;			// xorshift32 state for CXNN, never 0
+	uint8_t quirks;					// QuirkProfile, only change it with set_quirk_profile()
+	uint8_t flags[16];				// FX75 and FX85 store and load registers here, the RPL user flags of the HP 48
+
+	uint64_t dirty_pages[CHIP8_PAGES / 64];			// One bit per page of memory that has been written to since load_program()
+	uint64_t rom_hash;				// 64-bit FNV-1a of memory as load_program() left it, see load_program()
+	uint8_t loaded_memory[CHIP8_MEMORY_SIZE];		// Memory as load_program() left it, the pages that aren't dirty still match it
+
+	Instruction* code_pages[CHIP8_CODE_PAGES];		// Decode cache, one slot per even address, see fetch_instruction()
+	Chip8Jit* jit;					// Recompiler state, NULL unless create_jit() was called
+
+	uint8_t trace_state;			// TraceState, the latency trace isn't part of the emulated state
+	uint16_t trace_keys;			// The keys whose first read is traced
+	uint64_t trace_cycle;			// cycles when the ROM first read one of them
 
 } Chip8;					
 
+extern uint8_t fontset[80];
+extern uint8_t big_fontset[160];
+extern const char* quirk_profile_names[QUIRKS_COUNT];
+extern uint8_t quirk_profile_flags[QUIRKS_COUNT];
+
 Chip8* create_chip();
 void destroy_chip(Chip8* chip);
 int load_rom(Chip8* chip, const char* filename);
+int load_program(Chip8* chip, const uint8_t* program, size_t size);
 void emulate(Chip8* chip);
-void handle_event(SDL_Event e, Chip8* chip);
+ExitReason emulate_cycles(Chip8* chip, uint32_t budget);
+ExitReason emulate_frame(Chip8* chip);
+void tick_timers(Chip8* chip);
+IdleLoop idle_loop(const Chip8* chip, uint16_t address);
+void skip_idle_loop(Chip8* chip, IdleLoop loop, uint32_t cycles);
+const Instruction* fetch_instruction(Chip8* chip, Instruction* odd_instruction);
+void decode_opcode(uint16_t opcode, uint8_t profile, Instruction* instruction);
+void invalidate_code(Chip8* chip, uint16_t address);
+void drop_decoded(Chip8* chip, uint16_t address, uint32_t size);
+void flush_decoded(Chip8* chip);
+uint8_t draw_sprite(Chip8* chip, uint8_t x, uint8_t y, uint16_t address, uint8_t height);
+uint8_t blit_sprite(DisplayBuffer* display, const uint8_t* memory, uint8_t x, uint8_t y, uint16_t address, uint8_t height);
+uint8_t clip_sprite(DisplayBuffer* display, const uint8_t* memory, uint8_t x, uint8_t y, uint16_t address, uint8_t height);
+void clear_display(DisplayBuffer* display);
+void scroll_down(DisplayBuffer* display, uint8_t lines);
+void scroll_up(DisplayBuffer* display, uint8_t lines);
+void scroll_right(DisplayBuffer* display);
+void scroll_left(DisplayBuffer* display);
+void set_resolution(DisplayBuffer* display, uint8_t hires);
+void set_quirk_profile(Chip8* chip, QuirkProfile profile);
+int find_quirk_profile(const char* name);
+void set_key(Chip8* chip, uint8_t key, uint8_t down);
+uint8_t highest_key(uint16_t keys);
+void seed_chip(Chip8* chip, uint32_t seed);
+uint32_t seed_random(uint32_t seed);
+uint8_t next_random(uint32_t* state);
+uint64_t display_hash(const Chip8* chip);
+uint64_t hash_bytes(const uint8_t* data, size_t size);
 
 #endif
\ No newline at end of file
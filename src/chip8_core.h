@@ -0,0 +1,456 @@
+/*
+The body of emulate_cycles() for one quirk profile, chip8_threaded.c includes this once per profile.
+Define CORE_NAME as the name of the function and CORE_QUIRKS as the profile's QUIRK_ flags before including it.
+CORE_QUIRKS is a constant, so every QUIRK() check is resolved by the compiler and the loop of each
+profile only contains the behaviour of that profile. There is deliberately no include guard.
+*/
+
+ExitReason CORE_NAME(Chip8* chip, uint32_t budget)
+{
+#ifdef CHIPPY_THREADED_CORE
+	static void* targets[OP_COUNT] =
+	{
+		[OP_UNSUPPORTED] = &&target_OP_UNSUPPORTED,
+		[OP_00E0] = &&target_OP_00E0, [OP_00EE] = &&target_OP_00EE, [OP_00CN] = &&target_OP_00CN,
+		[OP_00DN] = &&target_OP_00DN, [OP_00FB] = &&target_OP_00FB, [OP_00FC] = &&target_OP_00FC, [OP_00FD] = &&target_OP_00FD,
+		[OP_00FE] = &&target_OP_00FE, [OP_00FF] = &&target_OP_00FF, [OP_1NNN] = &&target_OP_1NNN,
+		[OP_2NNN] = &&target_OP_2NNN, [OP_3XNN] = &&target_OP_3XNN, [OP_4XNN] = &&target_OP_4XNN,
+		[OP_5XY0] = &&target_OP_5XY0, [OP_5XY2] = &&target_OP_5XY2, [OP_5XY3] = &&target_OP_5XY3, [OP_6XNN] = &&target_OP_6XNN, [OP_7XNN] = &&target_OP_7XNN,
+		[OP_8XY0] = &&target_OP_8XY0, [OP_8XY1] = &&target_OP_8XY1, [OP_8XY2] = &&target_OP_8XY2,
+		[OP_8XY3] = &&target_OP_8XY3, [OP_8XY4] = &&target_OP_8XY4, [OP_8XY5] = &&target_OP_8XY5,
+		[OP_8XY6] = &&target_OP_8XY6, [OP_8XY7] = &&target_OP_8XY7, [OP_8XYE] = &&target_OP_8XYE,
+		[OP_9XY0] = &&target_OP_9XY0, [OP_ANNN] = &&target_OP_ANNN, [OP_BNNN] = &&target_OP_BNNN,
+		[OP_CXNN] = &&target_OP_CXNN, [OP_DXYN] = &&target_OP_DXYN, [OP_EX9E] = &&target_OP_EX9E,
+		[OP_EXA1] = &&target_OP_EXA1, [OP_F000] = &&target_OP_F000, [OP_FN01] = &&target_OP_FN01, [OP_F002] = &&target_OP_F002, [OP_FX07] = &&target_OP_FX07, [OP_FX0A] = &&target_OP_FX0A,
+		[OP_FX15] = &&target_OP_FX15, [OP_FX18] = &&target_OP_FX18, [OP_FX1E] = &&target_OP_FX1E,
+		[OP_FX29] = &&target_OP_FX29, [OP_FX30] = &&target_OP_FX30, [OP_FX33] = &&target_OP_FX33, [OP_FX3A] = &&target_OP_FX3A,
+		[OP_FX55] = &&target_OP_FX55, [OP_FX65] = &&target_OP_FX65, [OP_FX75] = &&target_OP_FX75,
+		[OP_FX85] = &&target_OP_FX85
+	};
+#endif
+
+	uint16_t pc = chip->program_counter;
+	uint16_t I = chip->I;
+	uint16_t sp = chip->stack_pointer;
+	uint32_t executed = 0;
+	Instruction odd_instruction;
+	const Instruction* instruction;
+
+	// Looks up the decoded instruction at pc, the chip only has to be synced on a cache miss
+#define FETCH() \
+	instruction = &chip->code_pages[pc / CHIP8_CODE_PAGE_SIZE][(pc % CHIP8_CODE_PAGE_SIZE) >> 1]; \
+	if ((pc & 1) || instruction->handler == NULL) \
+	{ \
+		chip->program_counter = pc; \
+		instruction = fetch_instruction(chip, &odd_instruction); \
+	}
+
+	// Writes the locals back and returns
+#define EXIT(reason) \
+	chip->program_counter = pc; \
+	chip->I = I; \
+	chip->stack_pointer = sp; \
+	chip->opcode = instruction->opcode; \
+	chip->cycles += executed; \
+	return reason
+
+	// Ends an instruction and stops once the budget is used up
+#define END_INSTRUCTION() \
+	if (++executed == budget) \
+	{ \
+		EXIT(EXIT_BUDGET_EXHAUSTED); \
+	}
+
+	// Ends an instruction that stops the batch, its reason wins over the budget running out with it
+#define END_AND_EXIT(reason) \
+	executed++; \
+	EXIT(reason)
+
+#ifdef CHIPPY_THREADED_CORE
+#define TARGET(form) case form: target_##form
+#define NEXT() \
+	END_INSTRUCTION(); \
+	FETCH(); \
+	goto *targets[instruction->form]
+#else
+#define TARGET(form) case form
+#define NEXT() \
+	END_INSTRUCTION(); \
+	continue
+#endif
+
+#define V(index) chip->V[index]
+#define VX chip->V[instruction->x]
+#define VY chip->V[instruction->y]
+#define SKIP_IF(condition) pc += (condition) ? CHIP8_SKIP_LENGTH(chip->memory, pc) : 2
+#define QUIRK(name) ((CORE_QUIRKS) & QUIRK_##name)
+
+	if (budget == 0)
+		return EXIT_BUDGET_EXHAUSTED;
+
+	for (;;)
+	{
+		FETCH();
+
+		switch (instruction->form)
+		{
+			TARGET(OP_UNSUPPORTED):
+				printf("Unsupported opcode: 0x%X\n", instruction->opcode);
+				END_AND_EXIT(EXIT_UNSUPPORTED_OPCODE);
+
+			TARGET(OP_00E0): // 0x00E0: Clears the screen
+				clear_display(&chip->display_buffer);
+				chip->redraw = 1;
+				pc += 2;
+				END_AND_EXIT(EXIT_FRAME_DRAWN);
+
+			TARGET(OP_00EE): // 0x00EE: Returns from subroutine
+				// Like stack_pop(), a return with nothing on the stack goes on with the next instruction
+				if (sp == 0)
+				{
+					printf("Stack underflow!");
+					pc += 2;
+					NEXT();
+				}
+				sp--;
+				pc = chip->stack[sp] + 2;
+				NEXT();
+
+			TARGET(OP_00CN): // 0x00CN: Scrolls the display down by N rows
+				scroll_down(&chip->display_buffer, instruction->n);
+				chip->redraw = 1;
+				pc += 2;
+				END_AND_EXIT(EXIT_FRAME_DRAWN);
+
+			TARGET(OP_00DN): // 0x00DN: Scrolls the display up by N rows
+				scroll_up(&chip->display_buffer, instruction->n);
+				chip->redraw = 1;
+				pc += 2;
+				END_AND_EXIT(EXIT_FRAME_DRAWN);
+
+			TARGET(OP_00FB): // 0x00FB: Scrolls the display right by 4 pixels
+				scroll_right(&chip->display_buffer);
+				chip->redraw = 1;
+				pc += 2;
+				END_AND_EXIT(EXIT_FRAME_DRAWN);
+
+			TARGET(OP_00FC): // 0x00FC: Scrolls the display left by 4 pixels
+				scroll_left(&chip->display_buffer);
+				chip->redraw = 1;
+				pc += 2;
+				END_AND_EXIT(EXIT_FRAME_DRAWN);
+
+			TARGET(OP_00FD): // 0x00FD: Exits the interpreter, the chip stays on it and idles like on a jump to itself
+				END_AND_EXIT(EXIT_IDLE);
+
+			TARGET(OP_00FE): // 0x00FE: Switches to the 64x32 display
+				set_resolution(&chip->display_buffer, 0);
+				chip->redraw = 1;
+				pc += 2;
+				END_AND_EXIT(EXIT_FRAME_DRAWN);
+
+			TARGET(OP_00FF): // 0x00FF: Switches to the 128x64 display of SUPER-CHIP
+				set_resolution(&chip->display_buffer, 1);
+				chip->redraw = 1;
+				pc += 2;
+				END_AND_EXIT(EXIT_FRAME_DRAWN);
+
+			TARGET(OP_1NNN): { // 0x1NNN: Jumps to address NNN
+				// Jumping to itself or back to a delay timer poll idles for the rest of the frame, emulate_frame() skips that.
+				// A jump back to FX0A doesn't count, FX0A ends the frame itself
+				IdleLoop loop = instruction->nnn == pc || instruction->nnn == pc - 4 ? idle_loop(chip, instruction->nnn) : IDLE_NONE;
+				pc = instruction->nnn;
+
+				if (loop == IDLE_JUMP || loop == IDLE_DELAY_POLL)
+				{
+					END_AND_EXIT(EXIT_IDLE);
+				}
+
+				NEXT();
+			}
+
+			TARGET(OP_2NNN): // 0x2NNN: Calls subroutine at NNN
+				// Like stack_push(), a call past the 16 levels isn't stored
+				if (sp == 16)
+					printf("Stack overflow!");
+				else
+					chip->stack[sp++] = pc;
+				pc = instruction->nnn;
+				NEXT();
+
+			TARGET(OP_3XNN): // 0x3XNN: Skips the next instruction if VX equals NN
+				SKIP_IF(VX == instruction->nn);
+				NEXT();
+
+			TARGET(OP_4XNN): // 0x4XNN: Skips the next instruction if VX doesn't equal NN
+				SKIP_IF(VX != instruction->nn);
+				NEXT();
+
+			TARGET(OP_5XY0): // 0x5XY0: Skips the next instruction if VX equals VY
+				SKIP_IF(VX == VY);
+				NEXT();
+
+			TARGET(OP_5XY2): { // 0x5XY2: Stores VX to VY in memory starting at address I, in reverse order when X is greater than Y
+				uint8_t count = instruction->x < instruction->y ? instruction->y - instruction->x : instruction->x - instruction->y;
+				int8_t step = instruction->x < instruction->y ? 1 : -1;
+				for (uint8_t i = 0; i <= count; i++)
+				{
+					chip->memory[(uint16_t)(I + i)] = V(instruction->x + i * step);
+					invalidate_code(chip, (uint16_t)(I + i));
+				}
+				pc += 2;
+				NEXT();
+			}
+
+			TARGET(OP_5XY3): { // 0x5XY3: Fills VX to VY with values from memory starting at address I, in reverse order when X is greater than Y
+				uint8_t count = instruction->x < instruction->y ? instruction->y - instruction->x : instruction->x - instruction->y;
+				int8_t step = instruction->x < instruction->y ? 1 : -1;
+				for (uint8_t i = 0; i <= count; i++)
+					V(instruction->x + i * step) = chip->memory[(uint16_t)(I + i)];
+				pc += 2;
+				NEXT();
+			}
+
+			TARGET(OP_6XNN): // 0x6XNN: Sets VX to NN
+				VX = instruction->nn;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_7XNN): // 0x7XNN: Adds NN to VX
+				VX += instruction->nn;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_8XY0): // 0x8XY0: Sets VX to the value of VY
+				VX = VY;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_8XY1): // 0x8XY1: Sets VX to "VX OR VY"
+				VX |= VY;
+				if (QUIRK(LOGIC_VF_RESET))
+					V(0xF) = 0;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_8XY2): // 0x8XY2: Sets VX to "VX AND VY"
+				VX &= VY;
+				if (QUIRK(LOGIC_VF_RESET))
+					V(0xF) = 0;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_8XY3): // 0x8XY3: Sets VX to "VX XOR VY"
+				VX ^= VY;
+				if (QUIRK(LOGIC_VF_RESET))
+					V(0xF) = 0;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_8XY4): // 0x8XY4: Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't
+				V(0xF) = VY > (0xFF - VX);
+				VX += VY;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_8XY5): // 0x8XY5: VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't
+				V(0xF) = !(VY > VX);
+				VX -= VY;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_8XY6): // 0x8XY6: Shifts VX (or VY) right by one. VF is set to the value of the least significant bit before the shift
+				if (QUIRK(SHIFT_VY))
+				{
+					uint8_t value = VY;
+					V(0xF) = value & 0x1;
+					VX = value >> 1;
+				}
+				else
+				{
+					V(0xF) = VX & 0x1;
+					VX >>= 1;
+				}
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_8XY7): // 0x8XY7: Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't
+				V(0xF) = !(VX > VY);
+				VX = VY - VX;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_8XYE): // 0x8XYE: Shifts VX (or VY) left by one. VF is set to the value of the most significant bit before the shift
+				if (QUIRK(SHIFT_VY))
+				{
+					uint8_t value = VY;
+					V(0xF) = value >> 7;
+					VX = value << 1;
+				}
+				else
+				{
+					V(0xF) = VX >> 7;
+					VX <<= 1;
+				}
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_9XY0): // 0x9XY0: Skips the next instruction if VX doesn't equal VY
+				SKIP_IF(VX != VY);
+				NEXT();
+
+			TARGET(OP_ANNN): // ANNN: Sets I to the address NNN
+				I = instruction->nnn;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_BNNN): // BNNN: Jumps to the address NNN plus V0, or XNN plus VX
+				pc = instruction->nnn + (QUIRK(JUMP_VX) ? VX : V(0));
+				NEXT();
+
+			TARGET(OP_CXNN): // CXNN: Sets VX to a random number, masked/"anded" by NN
+				VX = next_random(&chip->random_state) & instruction->nn;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_DXYN): // DXYN: Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels, DXY0 one of 16x16
+				V(0xF) = QUIRK(CLIP_SPRITES)
+					? clip_sprite(&chip->display_buffer, chip->memory, VX, VY, I, instruction->n)
+					: draw_sprite(chip, VX, VY, I, instruction->n);
+				chip->redraw = 1;
+				TRACE_DRAW(chip);
+				pc += 2;
+				END_AND_EXIT(EXIT_FRAME_DRAWN);
+
+			TARGET(OP_EX9E): // EX9E: Skips the next instruction if the key stored in VX is pressed
+				TRACE_KEY_READ(chip, 1 << (VX & 0xF), chip->cycles + executed);
+				SKIP_IF(chip->keys >> (VX & 0xF) & 1);
+				NEXT();
+
+			TARGET(OP_EXA1): // EXA1: Skips the next instruction if the key stored in VX isn't pressed
+				TRACE_KEY_READ(chip, 1 << (VX & 0xF), chip->cycles + executed);
+				SKIP_IF((chip->keys >> (VX & 0xF) & 1) == 0);
+				NEXT();
+
+			TARGET(OP_F000): // F000 NNNN: Sets I to the 16-bit address NNNN in the next two bytes
+				I = chip->memory[(uint16_t)(pc + 2)] << 8 | chip->memory[(uint16_t)(pc + 3)];
+				pc += 4;
+				NEXT();
+
+			TARGET(OP_FN01): // FN01: Selects the planes in the bits of N for drawing, scrolling and clearing
+				chip->display_buffer.plane_mask = instruction->x & ((1 << CHIP8_PLANES) - 1);
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_F002): // F002: Loads the 16 bytes at I into the audio pattern
+				for (int i = 0; i < 16; i++)
+					chip->audio_pattern[i] = chip->memory[(uint16_t)(I + i)];
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_FX07): // FX07: Sets VX to the value of the delay timer
+				VX = chip->delay_timer;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_FX0A): // FX0A: A key press is awaited, and then stored in VX
+				if (chip->keys != 0)
+				{
+					TRACE_KEY_READ(chip, chip->keys, chip->cycles + executed);
+					VX = highest_key(chip->keys);
+					pc += 2;
+					NEXT();
+				}
+
+				END_AND_EXIT(EXIT_WAITING_FOR_KEY);
+
+			TARGET(OP_FX15): // FX15: Sets the delay timer to VX
+				chip->delay_timer = VX;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_FX18): // FX18: Sets the sound timer to VX
+				chip->sound_timer = VX;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_FX1E): // FX1E: Adds VX to I, VF is set to 1 on range overflow (I + VX > 0xFFF)
+				V(0xF) = I + VX > 0xFFF;
+				I += VX;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_FX29): // FX29: Sets I to the location of the sprite for the character in VX
+				I = VX * 5;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_FX30): // FX30: Sets I to the location of the 8x10 sprite for the character in VX
+				I = CHIP8_BIG_FONT_ADDRESS + (VX & 0xF) * 10;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_FX33): { // FX33: Stores the Binary-coded decimal representation of VX at the addresses I, I plus 1, and I plus 2
+				uint8_t register_value = VX;
+				chip->memory[I] = register_value / 100;
+				chip->memory[(uint16_t)(I + 1)] = (register_value / 10) % 10;
+				chip->memory[(uint16_t)(I + 2)] = (register_value % 100) % 10;
+
+				for (uint8_t i = 0; i < 3; i++)
+					invalidate_code(chip, (uint16_t)(I + i));
+
+				pc += 2;
+				NEXT();
+			}
+
+			TARGET(OP_FX3A): // FX3A: Sets the pitch of the audio pattern to VX
+				chip->pitch = VX;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_FX55): // FX55: Stores V0 to VX in memory starting at address I
+				for (uint8_t i = 0; i <= instruction->x; i++)
+				{
+					chip->memory[(uint16_t)(I + i)] = V(i);
+					invalidate_code(chip, (uint16_t)(I + i));
+				}
+				if (QUIRK(LOAD_STORE_I))
+					I += instruction->x + 1;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_FX65): // FX65: Fills V0 to VX with values from memory starting at address I
+				for (uint8_t i = 0; i <= instruction->x; i++)
+					V(i) = chip->memory[(uint16_t)(I + i)];
+				if (QUIRK(LOAD_STORE_I))
+					I += instruction->x + 1;
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_FX75): // FX75: Stores V0 to VX in the user flags
+				memcpy(chip->flags, chip->V, instruction->x + 1);
+				pc += 2;
+				NEXT();
+
+			TARGET(OP_FX85): // FX85: Fills V0 to VX with the user flags
+				memcpy(chip->V, chip->flags, instruction->x + 1);
+				pc += 2;
+				NEXT();
+		}
+	}
+
+#undef FETCH
+#undef EXIT
+#undef END_INSTRUCTION
+#undef END_AND_EXIT
+#undef TARGET
+#undef NEXT
+#undef V
+#undef VX
+#undef VY
+#undef SKIP_IF
+#undef QUIRK
+}
+
+#undef CORE_NAME
+#undef CORE_QUIRKS
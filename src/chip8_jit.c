@@ -0,0 +1,380 @@
+#include "chip8_jit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#ifdef CHIP8_JIT_SUPPORTED
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+/*
+Straight-line runs of register-only instructions (6XNN, 7XNN, 8XYN, ANNN) are translated into
+native code, a run ends at the first instruction that can't be translated or after a 1NNN jump.
+Everything that touches memory, the timers, the keys, the stack or the display, as well as all
+skips and the other jumps, are left to the interpreter so the blocks never have side effects that
+would need to be undone.
+
+Blocks are only compiled in the first 4 KB of memory, where every jump target of a CHIP-8 ROM is.
+XO-CHIP code past it runs through the interpreter.
+
+The generated code only addresses the Chip8 struct through the pointer passed as the first
+argument and only uses RAX as a scratch register, which is volatile in both the System V and
+the Windows x64 calling convention.
+*/
+
+#define JIT_CODE_SIZE (256 * 1024)
+#define JIT_MAX_BLOCK_LENGTH 64
+#define JIT_MAX_INSTRUCTION_SIZE 32
+
+#ifdef _WIN32
+#define JIT_BASE_REGISTER 1			// RCX
+#else
+#define JIT_BASE_REGISTER 7			// RDI
+#endif
+
+#define JIT_REGISTER_AL 0
+
+#define JIT_BLOCK_EMPTY 0			// Not looked at yet
+#define JIT_BLOCK_COMPILED 1		// Native code is available
+#define JIT_BLOCK_INTERPRET 2		// The first instruction can't be compiled
+
+typedef void (*JitBlockEntry)(Chip8*);
+
+typedef struct {
+	uint8_t* entry;					// Native code for the block
+	uint16_t length;				// Number of CHIP-8 instructions in the block
+	uint8_t state;
+} JitBlock;
+
+struct Chip8Jit {
+	uint8_t* code;					// Executable buffer
+	size_t code_used;
+	JitBlock blocks[4096 / 2];		// One block per even address
+	uint8_t compiled[4096];			// Set for every byte of memory that is part of a compiled block
+};
+
+void compile_block(Chip8* chip, uint16_t address);
+uint8_t compile_instruction(uint8_t** code, uint16_t opcode, uint8_t quirks);
+void emit_byte(uint8_t** code, uint8_t value);
+void emit_memory_operand(uint8_t** code, uint8_t reg, uint32_t offset);
+void emit_store_word(uint8_t** code, uint32_t offset, uint16_t value);
+
+int create_jit(Chip8* chip)
+{
+	Chip8Jit* jit = (Chip8Jit*)malloc(sizeof(Chip8Jit));
+	if (jit == NULL)
+	{
+		printf("Could not create the JIT \n");
+		return 1;
+	}
+
+#ifdef _WIN32
+	jit->code = (uint8_t*)VirtualAlloc(NULL, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	jit->code = (uint8_t*)mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->code == MAP_FAILED)
+		jit->code = NULL;
+#endif
+
+	if (jit->code == NULL)
+	{
+		printf("Could not allocate executable memory for the JIT \n");
+		free(jit);
+		return 1;
+	}
+
+	chip->jit = jit;
+	jit_flush(chip);
+
+	return 0;
+}
+
+void destroy_jit(Chip8* chip)
+{
+	if (chip->jit == NULL)
+		return;
+
+#ifdef _WIN32
+	VirtualFree(chip->jit->code, 0, MEM_RELEASE);
+#else
+	munmap(chip->jit->code, JIT_CODE_SIZE);
+#endif
+
+	free(chip->jit);
+	chip->jit = NULL;
+}
+
+ExitReason emulate_jit(Chip8* chip, uint32_t budget)
+{
+	/*
+	Runs one compiled block, or a single instruction through the interpreter if there is none, and returns why it stopped.
+	Blocks can't stop half way, one that is longer than budget is left to the interpreter too so every build ends
+	the frame on the same instruction, movies recorded in one replay in the others.
+	*/
+	uint16_t address = chip->program_counter;
+	if ((address & 1) || address >= 4096 - 2)
+		return emulate_cycles(chip, 1);
+
+	JitBlock* block = &chip->jit->blocks[address >> 1];
+	if (block->state == JIT_BLOCK_EMPTY)
+		compile_block(chip, address);
+
+	if (block->state != JIT_BLOCK_COMPILED || block->length > budget)
+		return emulate_cycles(chip, 1);
+
+	((JitBlockEntry)block->entry)(chip);
+
+	chip->cycles += block->length;
+	return EXIT_BUDGET_EXHAUSTED;
+}
+
+void jit_invalidate(Chip8* chip, uint16_t address)
+{
+	Chip8Jit* jit = chip->jit;
+	if (address >= 4096)
+		return;
+
+	// Self modifying code is rare, throwing everything away keeps the bookkeeping trivial
+	if (jit->compiled[address])
+		jit_flush(chip);
+	else
+		jit->blocks[address >> 1].state = JIT_BLOCK_EMPTY;
+}
+
+void jit_flush(Chip8* chip)
+{
+	Chip8Jit* jit = chip->jit;
+	jit->code_used = 0;
+	memset(jit->blocks, 0, sizeof(jit->blocks));
+	memset(jit->compiled, 0, sizeof(jit->compiled));
+}
+
+void compile_block(Chip8* chip, uint16_t start)
+{
+	Chip8Jit* jit = chip->jit;
+	if (jit->code_used + (JIT_MAX_BLOCK_LENGTH + 2) * JIT_MAX_INSTRUCTION_SIZE > JIT_CODE_SIZE)
+		jit_flush(chip);
+
+	uint8_t* entry = jit->code + jit->code_used;
+	uint8_t* code = entry;
+	uint16_t address = start;
+	uint16_t length = 0;
+	uint16_t last_opcode = 0;
+	uint8_t jumped = 0;
+
+	while (length < JIT_MAX_BLOCK_LENGTH && address < 4096 - 2)
+	{
+		uint16_t opcode = chip->memory[address] << 8 | chip->memory[address + 1];
+
+		if ((opcode & 0xF000) == 0x1000)
+		{
+			// 0x1NNN: Jumps to address NNN, ends the block
+			emit_store_word(&code, offsetof(Chip8, program_counter), opcode & 0x0FFF);
+			jumped = 1;
+		}
+		else if (compile_instruction(&code, opcode, quirk_profile_flags[chip->quirks]) == 0)
+			break;
+
+		last_opcode = opcode;
+		length++;
+		address += 2;
+
+		if (jumped)
+			break;
+	}
+
+	JitBlock* block = &jit->blocks[start >> 1];
+	if (length == 0)
+	{
+		block->state = JIT_BLOCK_INTERPRET;
+		return;
+	}
+
+	if (jumped == 0)
+		emit_store_word(&code, offsetof(Chip8, program_counter), address);
+	emit_store_word(&code, offsetof(Chip8, opcode), last_opcode);
+	emit_byte(&code, 0xC3);									// ret
+
+	block->entry = entry;
+	block->length = length;
+	block->state = JIT_BLOCK_COMPILED;
+
+	jit->code_used += code - entry;
+	memset(&jit->compiled[start], 1, address - start);
+}
+
+uint8_t compile_instruction(uint8_t** code, uint16_t opcode, uint8_t quirks)
+{
+	// Emits the native code for a single instruction, returns 0 if the instruction has to be interpreted.
+	// The code is specialised for the QUIRK_ flags in quirks, set_quirk_profile() throws it away when they change
+	uint8_t x = (opcode & 0x0F00) >> 8;
+	uint8_t y = (opcode & 0x00F0) >> 4;
+	uint8_t nn = opcode & 0x00FF;
+	uint32_t vx = offsetof(Chip8, V) + x;
+	uint32_t vy = offsetof(Chip8, V) + y;
+	uint32_t vf = offsetof(Chip8, V) + 0xF;
+
+	switch (opcode & 0xF000)
+	{
+		case 0x6000: // 0x6XNN: Sets VX to NN
+			emit_byte(code, 0xC6);									// mov byte [VX], NN
+			emit_memory_operand(code, 0, vx);
+			emit_byte(code, nn);
+			return 1;
+
+		case 0x7000: // 0x7XNN: Adds NN to VX
+			emit_byte(code, 0x80);									// add byte [VX], NN
+			emit_memory_operand(code, 0, vx);
+			emit_byte(code, nn);
+			return 1;
+
+		case 0xA000: // ANNN: Sets I to the address NNN
+			emit_store_word(code, offsetof(Chip8, I), opcode & 0x0FFF);
+			return 1;
+
+		case 0x8000:
+			break;
+
+		default:
+			return 0;
+	}
+
+	// The flag setting forms write VF before VX in emulate(), leave the cases where the order matters to it
+	uint8_t sets_flag = (opcode & 0x000F) >= 0x0004;
+	if (sets_flag && (x == 0xF || y == 0xF))
+		return 0;
+
+	switch (opcode & 0x000F)
+	{
+		case 0x0000: // 0x8XY0: Sets VX to the value of VY
+			emit_byte(code, 0x8A);									// mov al, [VY]
+			emit_memory_operand(code, JIT_REGISTER_AL, vy);
+			emit_byte(code, 0x88);									// mov [VX], al
+			emit_memory_operand(code, JIT_REGISTER_AL, vx);
+			return 1;
+
+		case 0x0001: // 0x8XY1: Sets VX to "VX OR VY"
+		case 0x0002: // 0x8XY2: Sets VX to "VX AND VY"
+		case 0x0003: // 0x8XY3: Sets VX to "VX XOR VY"
+			emit_byte(code, 0x8A);									// mov al, [VY]
+			emit_memory_operand(code, JIT_REGISTER_AL, vy);
+			emit_byte(code, (opcode & 0x000F) == 0x0001 ? 0x08 : (opcode & 0x000F) == 0x0002 ? 0x20 : 0x30);	// or/and/xor [VX], al
+			emit_memory_operand(code, JIT_REGISTER_AL, vx);
+			if (quirks & QUIRK_LOGIC_VF_RESET)
+			{
+				emit_byte(code, 0xC6);								// mov byte [VF], 0
+				emit_memory_operand(code, 0, vf);
+				emit_byte(code, 0);
+			}
+			return 1;
+
+		case 0x0004: // 0x8XY4: Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't
+			emit_byte(code, 0x8A);									// mov al, [VX]
+			emit_memory_operand(code, JIT_REGISTER_AL, vx);
+			emit_byte(code, 0x02);									// add al, [VY]
+			emit_memory_operand(code, JIT_REGISTER_AL, vy);
+			emit_byte(code, 0x0F);									// setc [VF]
+			emit_byte(code, 0x92);
+			emit_memory_operand(code, 0, vf);
+			emit_byte(code, 0x88);									// mov [VX], al
+			emit_memory_operand(code, JIT_REGISTER_AL, vx);
+			return 1;
+
+		case 0x0005: // 0x8XY5: VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't
+		case 0x0007: // 0x8XY7: Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't
+			emit_byte(code, 0x8A);									// mov al, [VX] (or [VY] for 8XY7)
+			emit_memory_operand(code, JIT_REGISTER_AL, (opcode & 0x000F) == 0x0005 ? vx : vy);
+			emit_byte(code, 0x2A);									// sub al, [VY] (or [VX] for 8XY7)
+			emit_memory_operand(code, JIT_REGISTER_AL, (opcode & 0x000F) == 0x0005 ? vy : vx);
+			emit_byte(code, 0x0F);									// setnc [VF]
+			emit_byte(code, 0x93);
+			emit_memory_operand(code, 0, vf);
+			emit_byte(code, 0x88);									// mov [VX], al
+			emit_memory_operand(code, JIT_REGISTER_AL, vx);
+			return 1;
+
+		case 0x0006: // 0x8XY6: Shifts VX right by one. VF is set to the value of the least significant bit of VX before the shift
+		case 0x000E: // 0x8XYE: Shifts VX left by one. VF is set to the value of the most significant bit of VX before the shift
+			if (quirks & QUIRK_SHIFT_VY)
+			{
+				emit_byte(code, 0x8A);								// mov al, [VY]
+				emit_memory_operand(code, JIT_REGISTER_AL, vy);
+				emit_byte(code, 0xD0);								// shr/shl al, 1
+				emit_byte(code, (opcode & 0x000F) == 0x0006 ? 0xE8 : 0xE0);
+				emit_byte(code, 0x0F);								// setc [VF]
+				emit_byte(code, 0x92);
+				emit_memory_operand(code, 0, vf);
+				emit_byte(code, 0x88);								// mov [VX], al
+				emit_memory_operand(code, JIT_REGISTER_AL, vx);
+				return 1;
+			}
+
+			emit_byte(code, 0xD0);									// shr/shl byte [VX], 1
+			emit_memory_operand(code, (opcode & 0x000F) == 0x0006 ? 5 : 4, vx);
+			emit_byte(code, 0x0F);									// setc [VF]
+			emit_byte(code, 0x92);
+			emit_memory_operand(code, 0, vf);
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+void emit_byte(uint8_t** code, uint8_t value)
+{
+	**code = value;
+	(*code)++;
+}
+
+void emit_memory_operand(uint8_t** code, uint8_t reg, uint32_t offset)
+{
+	// ModRM for [base + disp32], neither RCX nor RDI needs a SIB byte
+	emit_byte(code, 0x80 | (reg << 3) | JIT_BASE_REGISTER);
+	emit_byte(code, offset & 0xFF);
+	emit_byte(code, (offset >> 8) & 0xFF);
+	emit_byte(code, (offset >> 16) & 0xFF);
+	emit_byte(code, (offset >> 24) & 0xFF);
+}
+
+void emit_store_word(uint8_t** code, uint32_t offset, uint16_t value)
+{
+	emit_byte(code, 0x66);									// mov word [offset], value
+	emit_byte(code, 0xC7);
+	emit_memory_operand(code, 0, offset);
+	emit_byte(code, value & 0xFF);
+	emit_byte(code, value >> 8);
+}
+
+#else
+
+int create_jit(Chip8* chip)
+{
+	printf("The JIT is not supported on this platform \n");
+	return 1;
+}
+
+void destroy_jit(Chip8* chip)
+{
+}
+
+ExitReason emulate_jit(Chip8* chip, uint32_t budget)
+{
+	return emulate_cycles(chip, 1);
+}
+
+void jit_invalidate(Chip8* chip, uint16_t address)
+{
+}
+
+void jit_flush(Chip8* chip)
+{
+}
+
+#endif
\ No newline at end of file
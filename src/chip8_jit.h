@@ -0,0 +1,17 @@
+#ifndef CHIP8_JIT_H
+#define CHIP8_JIT_H
+
+#include "chip8.h"
+
+// The recompiler emits x86-64 code, on every other target create_jit() fails and emulate() should be used instead
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_JIT_SUPPORTED 1
+#endif
+
+int create_jit(Chip8* chip);
+void destroy_jit(Chip8* chip);
+ExitReason emulate_jit(Chip8* chip, uint32_t budget);
+void jit_invalidate(Chip8* chip, uint16_t address);
+void jit_flush(Chip8* chip);
+
+#endif
\ No newline at end of file
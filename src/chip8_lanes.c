@@ -0,0 +1,266 @@
+#include "chip8_lanes.h"
+#include "chip8_jit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#define CHIPPY_LANES_AVX2 1
+#endif
+
+/*
+Lockstep execution.
+
+The lanes at the lowest program counter of the lanes still running this frame, and with the same opcode
+there, form the active mask and run as a group. Lanes that branched ahead wait until the lanes behind
+them catch up, which is where lanes that took different paths through an if or a loop meet again.
+The group keeps its program counter in a local and runs instruction after instruction for as long as
+its lanes stay together, until it reaches the address of a waiting lane or one of its lanes runs out
+of cycles for the frame. Scheduling and counting cycles only happen between groups.
+
+With AVX2 the register instructions (6XNN, 7XNN, 8XYN, the register compares and the timer moves) run
+for all 32 lanes at once, every result is blended into the registers under the active mask. Everything
+that touches memory, the display, the stack or the keys, and every instruction in builds without AVX2,
+runs through step_lane() one active lane at a time.
+
+Every lane behaves exactly like a chip running emulate_frame(): cycles_per_frame instructions per frame,
+and a lane that waits for a key or hits an unsupported opcode sits out the rest of the frame.
+The loop is compiled once per quirk profile in chip8_lanes_core.h, the forms a profile changes always run through step_lane().
+*/
+
+#define LANE_RUNNING 1
+#define LANE_STOPPED 0
+
+// What execute_lanes() returns instead of the next program counter
+#define LANES_SPLIT -1				// The lanes went to different addresses or some stopped, every lane's program counter is up to date
+#define LANES_NOT_HANDLED -2		// execute_lanes_avx2() can't run the instruction
+
+// Function prototypes
+uint32_t find_group(Chip8Lanes* lanes, uint32_t running, uint16_t* pc, uint16_t* next_pc, uint32_t* leader);
+uint8_t code_written(const Chip8Lanes* lanes, uint16_t pc);
+void mark_written(Chip8Lanes* lanes, uint16_t address);
+uint8_t same_opcode(const Chip8Lanes* lanes, uint32_t mask, uint16_t pc, uint16_t opcode);
+void set_lanes_word(uint16_t* words, uint32_t mask, uint16_t value);
+void emulate_lanes_frame_modern(Chip8Lanes* lanes);
+void emulate_lanes_frame_cosmac(Chip8Lanes* lanes);
+void emulate_lanes_frame_schip(Chip8Lanes* lanes);
+void emulate_lanes_frame_xochip(Chip8Lanes* lanes);
+
+Chip8Lanes* create_lanes(uint32_t lane_count)
+{
+	if (lane_count == 0 || lane_count > CHIP8_MAX_LANES)
+	{
+		printf("Lanes can only run 1 to %d instances \n", CHIP8_MAX_LANES);
+		return NULL;
+	}
+
+	Chip8Lanes* lanes = (Chip8Lanes*)calloc(1, sizeof(Chip8Lanes));
+	if (lanes == NULL)
+	{
+		printf("Could not create the lanes :(");
+		return NULL;
+	}
+
+	lanes->lane_count = lane_count;
+	lanes->cycles_per_frame = 10;
+
+	for (uint32_t lane = 0; lane < CHIP8_MAX_LANES; lane++)
+	{
+		lanes->program_counter[lane] = 0x200;
+		lanes->random_state[lane] = seed_random(CHIP8_DEFAULT_SEED);
+		memcpy(lanes->memory[lane], fontset, sizeof(fontset));
+		memcpy(&lanes->memory[lane][CHIP8_BIG_FONT_ADDRESS], big_fontset, sizeof(big_fontset));
+		lanes->display_buffer[lane].plane_mask = 1;
+		memset(lanes->audio_pattern[lane], CHIP8_DEFAULT_AUDIO_PATTERN, sizeof(lanes->audio_pattern[lane]));
+		lanes->pitch[lane] = CHIP8_DEFAULT_PITCH;
+	}
+
+	return lanes;
+}
+
+void destroy_lanes(Chip8Lanes* lanes)
+{
+	free(lanes);
+}
+
+int load_lanes_program(Chip8Lanes* lanes, const uint8_t* program, size_t size)
+{
+	// Every lane runs the same ROM
+	if (size > CHIP8_MEMORY_SIZE - 512)
+	{
+		printf("The ROM can not be larger then %d bytes \n", CHIP8_MEMORY_SIZE - 512);
+		return 1;
+	}
+
+	for (uint32_t lane = 0; lane < CHIP8_MAX_LANES; lane++)
+		memcpy(&lanes->memory[lane][512], program, size);
+
+	memset(lanes->decoded, 0, sizeof(lanes->decoded));
+	memset(lanes->written_pages, 0, sizeof(lanes->written_pages));
+
+	return 0;
+}
+
+void set_lane_key(Chip8Lanes* lanes, uint32_t lane, uint8_t key, uint8_t down)
+{
+	if (down)
+		lanes->keys[lane % CHIP8_MAX_LANES] |= 1 << (key & 0xF);
+	else
+		lanes->keys[lane % CHIP8_MAX_LANES] &= ~(1 << (key & 0xF));
+}
+
+void seed_lane(Chip8Lanes* lanes, uint32_t lane, uint32_t seed)
+{
+	// A lane runs like a chip that seed_chip() was called on with the same seed
+	lanes->random_state[lane % CHIP8_MAX_LANES] = seed_random(seed);
+}
+
+void copy_lane(const Chip8Lanes* lanes, uint32_t lane, Chip8* chip)
+{
+	// Copies the state of one lane into a chip, to inspect it or to carry on with it on its own
+	for (int i = 0; i < 16; i++)
+	{
+		chip->V[i] = lanes->V[i][lane];
+		chip->stack[i] = lanes->stack[lane][i];
+	}
+
+	chip->keys = lanes->keys[lane];
+	chip->program_counter = lanes->program_counter[lane];
+	chip->I = lanes->I[lane];
+	chip->stack_pointer = lanes->stack_pointer[lane];
+	chip->delay_timer = lanes->delay_timer[lane];
+	chip->sound_timer = lanes->sound_timer[lane];
+	chip->pitch = lanes->pitch[lane];
+	chip->cycles = lanes->cycles[lane];
+	chip->random_state = lanes->random_state[lane];
+	chip->frame_cycles = 0;
+	chip->cycles_per_frame = lanes->cycles_per_frame;
+	chip->quirks = lanes->quirks;
+	memcpy(&chip->display_buffer, &lanes->display_buffer[lane], sizeof(chip->display_buffer));
+	memcpy(chip->flags, lanes->flags[lane], sizeof(chip->flags));
+	memcpy(chip->audio_pattern, lanes->audio_pattern[lane], sizeof(chip->audio_pattern));
+	memcpy(chip->memory, lanes->memory[lane], sizeof(chip->memory));
+	chip->redraw = 1;
+
+	// Pages no lane wrote to still match the ROM, save states of the chip are right when it was loaded with the same ROM
+	memcpy(chip->dirty_pages, lanes->written_pages, sizeof(chip->dirty_pages));
+
+	flush_decoded(chip);
+	if (chip->jit != NULL)
+		jit_flush(chip);
+}
+
+void emulate_lanes_frame(Chip8Lanes* lanes)
+{
+	// The loop is in chip8_lanes_core.h, compiled once for every quirk profile
+	switch (lanes->quirks)
+	{
+		case QUIRKS_COSMAC:
+			emulate_lanes_frame_cosmac(lanes);
+			break;
+
+		case QUIRKS_SCHIP:
+			emulate_lanes_frame_schip(lanes);
+			break;
+
+		case QUIRKS_XOCHIP:
+			emulate_lanes_frame_xochip(lanes);
+			break;
+
+		default:
+			emulate_lanes_frame_modern(lanes);
+			break;
+	}
+}
+
+uint32_t find_group(Chip8Lanes* lanes, uint32_t running, uint16_t* pc, uint16_t* next_pc, uint32_t* leader)
+{
+	/*
+	Returns the running lanes at the lowest program counter that have the same opcode there as the first of them.
+	next_pc is the lowest program counter of the running lanes that were left out, the group stops there so they can join it.
+	*/
+	uint16_t lowest = 0xFFFF;
+	uint32_t first = 0;
+	for (uint32_t lane = 0; lane < lanes->lane_count; lane++)
+	{
+		if ((running >> lane & 1) && lanes->program_counter[lane] < lowest)
+		{
+			lowest = lanes->program_counter[lane];
+			first = lane;
+		}
+	}
+
+	const uint8_t* code = lanes->memory[first];
+	uint16_t opcode = code[lowest] << 8 | code[(uint16_t)(lowest + 1)];
+	uint8_t check_opcode = code_written(lanes, lowest);
+	uint32_t mask = 0;
+	uint16_t others = 0xFFFF;
+
+	for (uint32_t lane = 0; lane < lanes->lane_count; lane++)
+	{
+		if ((running >> lane & 1) == 0)
+			continue;
+
+		code = lanes->memory[lane];
+		if (lanes->program_counter[lane] == lowest
+			&& (!check_opcode || (code[lowest] << 8 | code[(uint16_t)(lowest + 1)]) == opcode))
+			mask |= 1u << lane;
+		else if (lanes->program_counter[lane] < others)
+			others = lanes->program_counter[lane];
+	}
+
+	*pc = lowest;
+	*next_pc = others;
+	*leader = first;
+	return mask;
+}
+
+uint8_t code_written(const Chip8Lanes* lanes, uint16_t pc)
+{
+	// Whether any lane has written to the opcode at pc
+	uint16_t first = pc / CHIP8_PAGE_SIZE;
+	uint16_t second = (uint16_t)(pc + 1) / CHIP8_PAGE_SIZE;
+	return ((lanes->written_pages[first / 64] >> (first % 64)) & 1) || ((lanes->written_pages[second / 64] >> (second % 64)) & 1);
+}
+
+void mark_written(Chip8Lanes* lanes, uint16_t address)
+{
+	uint16_t page = address / CHIP8_PAGE_SIZE;
+	lanes->written_pages[page / 64] |= (uint64_t)1 << (page % 64);
+}
+
+uint8_t same_opcode(const Chip8Lanes* lanes, uint32_t mask, uint16_t pc, uint16_t opcode)
+{
+	for (uint32_t lane = 0; lane < lanes->lane_count; lane++)
+	{
+		const uint8_t* code = lanes->memory[lane];
+		if ((mask >> lane & 1) && (code[pc] << 8 | code[(uint16_t)(pc + 1)]) != opcode)
+			return 0;
+	}
+
+	return 1;
+}
+
+void set_lanes_word(uint16_t* words, uint32_t mask, uint16_t value)
+{
+	for (uint32_t lane = 0; lane < CHIP8_MAX_LANES; lane++)
+		words[lane] = (mask >> lane & 1) ? value : words[lane];
+}
+
+#define LANES_NAME(name) name##_modern
+#define CORE_QUIRKS QUIRKS_MODERN_FLAGS
+#include "chip8_lanes_core.h"
+
+#define LANES_NAME(name) name##_cosmac
+#define CORE_QUIRKS QUIRKS_COSMAC_FLAGS
+#include "chip8_lanes_core.h"
+
+#define LANES_NAME(name) name##_schip
+#define CORE_QUIRKS QUIRKS_SCHIP_FLAGS
+#include "chip8_lanes_core.h"
+
+#define LANES_NAME(name) name##_xochip
+#define CORE_QUIRKS QUIRKS_XOCHIP_FLAGS
+#include "chip8_lanes_core.h"
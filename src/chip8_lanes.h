@@ -0,0 +1,47 @@
+#ifndef CHIP8_LANES_H
+#define CHIP8_LANES_H
+
+#include "chip8.h"
+
+#define CHIP8_MAX_LANES 32
+
+/*
+Up to 32 instances of one ROM that run in lockstep, every instance is a lane.
+The registers are stored as structure of arrays, V[register][lane], so the same register of every lane
+is 32 consecutive bytes and one AVX2 register. Memory, the display and the stack are only used by
+instructions that run lane by lane anyway and are stored per lane.
+*/
+typedef struct Chip8Lanes {
+	uint8_t V[16][CHIP8_MAX_LANES];
+	uint8_t delay_timer[CHIP8_MAX_LANES];
+	uint8_t sound_timer[CHIP8_MAX_LANES];
+	uint16_t program_counter[CHIP8_MAX_LANES];
+	uint16_t I[CHIP8_MAX_LANES];
+	uint16_t stack_pointer[CHIP8_MAX_LANES];
+	uint16_t stack[CHIP8_MAX_LANES][16];
+	uint16_t keys[CHIP8_MAX_LANES];			// Bit N is set while key N is down
+	DisplayBuffer display_buffer[CHIP8_MAX_LANES];
+	uint8_t flags[CHIP8_MAX_LANES][16];
+	uint8_t audio_pattern[CHIP8_MAX_LANES][16];
+	uint8_t pitch[CHIP8_MAX_LANES];
+	uint32_t random_state[CHIP8_MAX_LANES];
+	uint8_t memory[CHIP8_MAX_LANES][CHIP8_MEMORY_SIZE];
+
+	uint64_t cycles[CHIP8_MAX_LANES];		// Instructions executed by every lane
+	uint64_t steps;							// Lockstep steps, cycles / steps is how many lanes ran together on average
+	uint64_t written_pages[CHIP8_PAGES / 64];	// Pages of memory any lane has written to, the code there may differ between lanes
+	Instruction decoded[4096 / 2];			// Decode cache indexed by the low 12 bits of the address, only used when the opcode still matches
+	uint32_t lane_count;
+	uint32_t cycles_per_frame;				// Instructions per 1/60 s of emulated time, for every lane
+	uint8_t quirks;							// QuirkProfile of every lane
+} Chip8Lanes;
+
+Chip8Lanes* create_lanes(uint32_t lane_count);
+void destroy_lanes(Chip8Lanes* lanes);
+int load_lanes_program(Chip8Lanes* lanes, const uint8_t* program, size_t size);
+void emulate_lanes_frame(Chip8Lanes* lanes);
+void set_lane_key(Chip8Lanes* lanes, uint32_t lane, uint8_t key, uint8_t down);
+void seed_lane(Chip8Lanes* lanes, uint32_t lane, uint32_t seed);
+void copy_lane(const Chip8Lanes* lanes, uint32_t lane, Chip8* chip);
+
+#endif
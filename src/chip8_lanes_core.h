@@ -0,0 +1,644 @@
+/*
+The lockstep loop of emulate_lanes_frame() for one quirk profile, chip8_lanes.c includes this once per profile.
+Define LANES_NAME(name) to add the profile to the names of the functions and CORE_QUIRKS as the profile's QUIRK_ flags
+before including it. Like in chip8_core.h every QUIRK() check is resolved by the compiler, neither step_lane() nor
+execute_lanes_avx2() looks at the profile while running. There is deliberately no include guard.
+*/
+
+// Function prototypes
+void LANES_NAME(emulate_lanes_frame)(Chip8Lanes* lanes);
+int32_t LANES_NAME(execute_lanes)(Chip8Lanes* lanes, const Instruction* instruction, uint32_t mask, uint16_t pc, uint32_t* stopped);
+uint8_t LANES_NAME(step_lane)(Chip8Lanes* lanes, uint32_t lane, const Instruction* instruction);
+#ifdef CHIPPY_LANES_AVX2
+int32_t LANES_NAME(execute_lanes_avx2)(Chip8Lanes* lanes, const Instruction* instruction, uint32_t mask, uint16_t pc);
+#endif
+
+#define QUIRK(name) ((CORE_QUIRKS) & QUIRK_##name)
+
+void LANES_NAME(emulate_lanes_frame)(Chip8Lanes* lanes)
+{
+	uint32_t frame_cycles[CHIP8_MAX_LANES] = { 0 };
+	uint32_t running = lanes->lane_count == 32 ? 0xFFFFFFFF : (1u << lanes->lane_count) - 1;
+	Instruction odd_instruction;
+
+	if (lanes->cycles_per_frame == 0)
+		running = 0;
+
+	while (running != 0)
+	{
+		uint16_t pc;
+		uint16_t next_pc;
+		uint32_t leader;
+		uint32_t mask = find_group(lanes, running, &pc, &next_pc, &leader);
+
+		// The group can run until its first lane has used up the frame
+		uint32_t budget = 0xFFFFFFFF;
+		for (uint32_t lane = 0; lane < lanes->lane_count; lane++)
+		{
+			if ((mask >> lane & 1) && lanes->cycles_per_frame - frame_cycles[lane] < budget)
+				budget = lanes->cycles_per_frame - frame_cycles[lane];
+		}
+
+		const uint8_t* code = lanes->memory[leader];
+		uint32_t steps = 0;
+		uint32_t stopped = 0;
+
+		for (;;)
+		{
+			uint16_t opcode = code[pc] << 8 | code[(uint16_t)(pc + 1)];
+
+			// Code in pages that were written to may differ between the lanes, find_group() splits them up
+			if (steps > 0 && code_written(lanes, pc) && !same_opcode(lanes, mask, pc, opcode))
+			{
+				set_lanes_word(lanes->program_counter, mask, pc);
+				break;
+			}
+
+			const Instruction* instruction = &lanes->decoded[(pc & 0x0FFF) >> 1];
+			if (pc & 1)
+			{
+				decode_opcode(opcode, lanes->quirks, &odd_instruction);
+				instruction = &odd_instruction;
+			}
+			else if (instruction->handler == NULL || instruction->opcode != opcode)
+				decode_opcode(opcode, lanes->quirks, &lanes->decoded[(pc & 0x0FFF) >> 1]);
+
+			int32_t next = LANES_NAME(execute_lanes)(lanes, instruction, mask, pc, &stopped);
+			steps++;
+
+			if (next == LANES_SPLIT)
+				break;
+
+			pc = (uint16_t)next;
+			if (steps == budget || pc >= next_pc)
+			{
+				set_lanes_word(lanes->program_counter, mask, pc);
+				break;
+			}
+		}
+
+		lanes->steps += steps;
+		for (uint32_t lane = 0; lane < lanes->lane_count; lane++)
+		{
+			if ((mask >> lane & 1) == 0)
+				continue;
+
+			lanes->cycles[lane] += steps;
+			frame_cycles[lane] += steps;
+			if (frame_cycles[lane] == lanes->cycles_per_frame)
+				running &= ~(1u << lane);
+		}
+
+		running &= ~stopped;
+	}
+
+	// Update the sound and delay timers of every lane, 60 times per second of emulated time
+#ifdef CHIPPY_LANES_AVX2
+	__m256i one = _mm256_set1_epi8(1);
+	_mm256_storeu_si256((__m256i*)lanes->delay_timer, _mm256_subs_epu8(_mm256_loadu_si256((const __m256i*)lanes->delay_timer), one));
+	_mm256_storeu_si256((__m256i*)lanes->sound_timer, _mm256_subs_epu8(_mm256_loadu_si256((const __m256i*)lanes->sound_timer), one));
+#else
+	for (uint32_t lane = 0; lane < CHIP8_MAX_LANES; lane++)
+	{
+		if (lanes->delay_timer[lane] > 0)
+			lanes->delay_timer[lane]--;
+
+		if (lanes->sound_timer[lane] > 0)
+			lanes->sound_timer[lane]--;
+	}
+#endif
+}
+
+int32_t LANES_NAME(execute_lanes)(Chip8Lanes* lanes, const Instruction* instruction, uint32_t mask, uint16_t pc, uint32_t* stopped)
+{
+	/*
+	Runs one instruction in every lane in mask, they are all at pc. Their program counters in lanes may be stale,
+	returns the address all of them continue at, or LANES_SPLIT after storing every lane's own program counter.
+	Lanes that are done for this frame are added to stopped.
+	*/
+	switch (instruction->form)
+	{
+		case OP_1NNN:
+			return instruction->nnn;
+
+		case OP_ANNN:
+			set_lanes_word(lanes->I, mask, instruction->nnn);
+			return pc + 2;
+
+		default:
+			break;
+	}
+
+#ifdef CHIPPY_LANES_AVX2
+	int32_t next = LANES_NAME(execute_lanes_avx2)(lanes, instruction, mask, pc);
+	if (next != LANES_NOT_HANDLED)
+		return next;
+#endif
+
+	set_lanes_word(lanes->program_counter, mask, pc);
+
+	int32_t together = 0x10000;		// Not an address, no lane has run yet
+	for (uint32_t lane = 0; lane < lanes->lane_count; lane++)
+	{
+		if ((mask >> lane & 1) == 0)
+			continue;
+
+		if (LANES_NAME(step_lane)(lanes, lane, instruction) == LANE_STOPPED)
+			*stopped |= 1u << lane;
+
+		if (together == 0x10000)
+			together = lanes->program_counter[lane];
+		else if (together != lanes->program_counter[lane])
+			together = LANES_SPLIT;
+	}
+
+	return *stopped != 0 ? LANES_SPLIT : together;
+}
+
+uint8_t LANES_NAME(step_lane)(Chip8Lanes* lanes, uint32_t lane, const Instruction* instruction)
+{
+	// Runs one instruction in one lane, the same way emulate_cycles() does
+	uint16_t pc = lanes->program_counter[lane];
+	uint16_t I = lanes->I[lane];
+	uint16_t sp = lanes->stack_pointer[lane];
+	uint8_t* memory = lanes->memory[lane];
+	uint16_t* stack = lanes->stack[lane];
+	uint16_t keys = lanes->keys[lane];
+	uint8_t result = LANE_RUNNING;
+
+#define V(index) lanes->V[index][lane]
+#define VX V(instruction->x)
+#define VY V(instruction->y)
+#define SKIP_IF(condition) pc += (condition) ? CHIP8_SKIP_LENGTH(memory, pc) : 2
+
+	switch (instruction->form)
+	{
+		case OP_UNSUPPORTED:
+			printf("Unsupported opcode: 0x%X\n", instruction->opcode);
+			result = LANE_STOPPED;
+			break;
+
+		case OP_00E0: // 0x00E0: Clears the screen
+			clear_display(&lanes->display_buffer[lane]);
+			pc += 2;
+			break;
+
+		case OP_00EE: // 0x00EE: Returns from subroutine
+			// Like stack_pop(), a return with nothing on the stack goes on with the next instruction
+			if (sp == 0)
+			{
+				printf("Stack underflow!");
+				pc += 2;
+				break;
+			}
+			sp--;
+			pc = stack[sp] + 2;
+			break;
+
+		case OP_00CN: // 0x00CN: Scrolls the display down by N rows
+			scroll_down(&lanes->display_buffer[lane], instruction->n);
+			pc += 2;
+			break;
+
+		case OP_00DN: // 0x00DN: Scrolls the display up by N rows
+			scroll_up(&lanes->display_buffer[lane], instruction->n);
+			pc += 2;
+			break;
+
+		case OP_00FB: // 0x00FB: Scrolls the display right by 4 pixels
+			scroll_right(&lanes->display_buffer[lane]);
+			pc += 2;
+			break;
+
+		case OP_00FC: // 0x00FC: Scrolls the display left by 4 pixels
+			scroll_left(&lanes->display_buffer[lane]);
+			pc += 2;
+			break;
+
+		case OP_00FD: // 0x00FD: Exits the interpreter, the lane stays on it
+			break;
+
+		case OP_00FE: // 0x00FE: Switches to the 64x32 display
+			set_resolution(&lanes->display_buffer[lane], 0);
+			pc += 2;
+			break;
+
+		case OP_00FF: // 0x00FF: Switches to the 128x64 display of SUPER-CHIP
+			set_resolution(&lanes->display_buffer[lane], 1);
+			pc += 2;
+			break;
+
+		case OP_1NNN: // 0x1NNN: Jumps to address NNN
+			pc = instruction->nnn;
+			break;
+
+		case OP_2NNN: // 0x2NNN: Calls subroutine at NNN
+			// Like stack_push(), a call past the 16 levels isn't stored
+			if (sp == 16)
+				printf("Stack overflow!");
+			else
+				stack[sp++] = pc;
+			pc = instruction->nnn;
+			break;
+
+		case OP_3XNN: // 0x3XNN: Skips the next instruction if VX equals NN
+			SKIP_IF(VX == instruction->nn);
+			break;
+
+		case OP_4XNN: // 0x4XNN: Skips the next instruction if VX doesn't equal NN
+			SKIP_IF(VX != instruction->nn);
+			break;
+
+		case OP_5XY0: // 0x5XY0: Skips the next instruction if VX equals VY
+			SKIP_IF(VX == VY);
+			break;
+
+		case OP_5XY2: { // 0x5XY2: Stores VX to VY in memory starting at address I, in reverse order when X is greater than Y
+			uint8_t count = instruction->x < instruction->y ? instruction->y - instruction->x : instruction->x - instruction->y;
+			int8_t step = instruction->x < instruction->y ? 1 : -1;
+			for (uint8_t i = 0; i <= count; i++)
+			{
+				memory[(uint16_t)(I + i)] = V(instruction->x + i * step);
+				mark_written(lanes, (uint16_t)(I + i));
+			}
+			pc += 2;
+			break;
+		}
+
+		case OP_5XY3: { // 0x5XY3: Fills VX to VY with values from memory starting at address I, in reverse order when X is greater than Y
+			uint8_t count = instruction->x < instruction->y ? instruction->y - instruction->x : instruction->x - instruction->y;
+			int8_t step = instruction->x < instruction->y ? 1 : -1;
+			for (uint8_t i = 0; i <= count; i++)
+				V(instruction->x + i * step) = memory[(uint16_t)(I + i)];
+			pc += 2;
+			break;
+		}
+
+		case OP_6XNN: // 0x6XNN: Sets VX to NN
+			VX = instruction->nn;
+			pc += 2;
+			break;
+
+		case OP_7XNN: // 0x7XNN: Adds NN to VX
+			VX += instruction->nn;
+			pc += 2;
+			break;
+
+		case OP_8XY0: // 0x8XY0: Sets VX to the value of VY
+			VX = VY;
+			pc += 2;
+			break;
+
+		case OP_8XY1: // 0x8XY1: Sets VX to "VX OR VY"
+			VX |= VY;
+			if (QUIRK(LOGIC_VF_RESET))
+				V(0xF) = 0;
+			pc += 2;
+			break;
+
+		case OP_8XY2: // 0x8XY2: Sets VX to "VX AND VY"
+			VX &= VY;
+			if (QUIRK(LOGIC_VF_RESET))
+				V(0xF) = 0;
+			pc += 2;
+			break;
+
+		case OP_8XY3: // 0x8XY3: Sets VX to "VX XOR VY"
+			VX ^= VY;
+			if (QUIRK(LOGIC_VF_RESET))
+				V(0xF) = 0;
+			pc += 2;
+			break;
+
+		case OP_8XY4: // 0x8XY4: Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't
+			V(0xF) = VY > (0xFF - VX);
+			VX += VY;
+			pc += 2;
+			break;
+
+		case OP_8XY5: // 0x8XY5: VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't
+			V(0xF) = !(VY > VX);
+			VX -= VY;
+			pc += 2;
+			break;
+
+		case OP_8XY6: // 0x8XY6: Shifts VX (or VY) right by one. VF is set to the value of the least significant bit before the shift
+			if (QUIRK(SHIFT_VY))
+			{
+				uint8_t value = VY;
+				V(0xF) = value & 0x1;
+				VX = value >> 1;
+			}
+			else
+			{
+				V(0xF) = VX & 0x1;
+				VX >>= 1;
+			}
+			pc += 2;
+			break;
+
+		case OP_8XY7: // 0x8XY7: Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't
+			V(0xF) = !(VX > VY);
+			VX = VY - VX;
+			pc += 2;
+			break;
+
+		case OP_8XYE: // 0x8XYE: Shifts VX (or VY) left by one. VF is set to the value of the most significant bit before the shift
+			if (QUIRK(SHIFT_VY))
+			{
+				uint8_t value = VY;
+				V(0xF) = value >> 7;
+				VX = value << 1;
+			}
+			else
+			{
+				V(0xF) = VX >> 7;
+				VX <<= 1;
+			}
+			pc += 2;
+			break;
+
+		case OP_9XY0: // 0x9XY0: Skips the next instruction if VX doesn't equal VY
+			SKIP_IF(VX != VY);
+			break;
+
+		case OP_ANNN: // ANNN: Sets I to the address NNN
+			I = instruction->nnn;
+			pc += 2;
+			break;
+
+		case OP_BNNN: // BNNN: Jumps to the address NNN plus V0, or XNN plus VX
+			pc = instruction->nnn + (QUIRK(JUMP_VX) ? VX : V(0));
+			break;
+
+		case OP_CXNN: // CXNN: Sets VX to a random number, masked/"anded" by NN
+			VX = next_random(&lanes->random_state[lane]) & instruction->nn;
+			pc += 2;
+			break;
+
+		case OP_DXYN: // DXYN: Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels, DXY0 one of 16x16
+			V(0xF) = QUIRK(CLIP_SPRITES)
+				? clip_sprite(&lanes->display_buffer[lane], memory, VX, VY, I, instruction->n)
+				: blit_sprite(&lanes->display_buffer[lane], memory, VX, VY, I, instruction->n);
+			pc += 2;
+			break;
+
+		case OP_EX9E: // EX9E: Skips the next instruction if the key stored in VX is pressed
+			SKIP_IF(keys >> (VX & 0xF) & 1);
+			break;
+
+		case OP_EXA1: // EXA1: Skips the next instruction if the key stored in VX isn't pressed
+			SKIP_IF((keys >> (VX & 0xF) & 1) == 0);
+			break;
+
+		case OP_F000: // F000 NNNN: Sets I to the 16-bit address NNNN in the next two bytes
+			I = memory[(uint16_t)(pc + 2)] << 8 | memory[(uint16_t)(pc + 3)];
+			pc += 4;
+			break;
+
+		case OP_FN01: // FN01: Selects the planes in the bits of N for drawing, scrolling and clearing
+			lanes->display_buffer[lane].plane_mask = instruction->x & ((1 << CHIP8_PLANES) - 1);
+			pc += 2;
+			break;
+
+		case OP_F002: // F002: Loads the 16 bytes at I into the audio pattern
+			for (int i = 0; i < 16; i++)
+				lanes->audio_pattern[lane][i] = memory[(uint16_t)(I + i)];
+			pc += 2;
+			break;
+
+		case OP_FX07: // FX07: Sets VX to the value of the delay timer
+			VX = lanes->delay_timer[lane];
+			pc += 2;
+			break;
+
+		case OP_FX0A: // FX0A: A key press is awaited, and then stored in VX
+			if (keys != 0)
+			{
+				VX = highest_key(keys);
+				pc += 2;
+			}
+			else
+				result = LANE_STOPPED;
+			break;
+
+		case OP_FX15: // FX15: Sets the delay timer to VX
+			lanes->delay_timer[lane] = VX;
+			pc += 2;
+			break;
+
+		case OP_FX18: // FX18: Sets the sound timer to VX
+			lanes->sound_timer[lane] = VX;
+			pc += 2;
+			break;
+
+		case OP_FX1E: // FX1E: Adds VX to I, VF is set to 1 on range overflow (I + VX > 0xFFF)
+			V(0xF) = I + VX > 0xFFF;
+			I += VX;
+			pc += 2;
+			break;
+
+		case OP_FX29: // FX29: Sets I to the location of the sprite for the character in VX
+			I = VX * 5;
+			pc += 2;
+			break;
+
+		case OP_FX30: // FX30: Sets I to the location of the 8x10 sprite for the character in VX
+			I = CHIP8_BIG_FONT_ADDRESS + (VX & 0xF) * 10;
+			pc += 2;
+			break;
+
+		case OP_FX33: { // FX33: Stores the Binary-coded decimal representation of VX at the addresses I, I plus 1, and I plus 2
+			uint8_t register_value = VX;
+			memory[I] = register_value / 100;
+			memory[(uint16_t)(I + 1)] = (register_value / 10) % 10;
+			memory[(uint16_t)(I + 2)] = (register_value % 100) % 10;
+			mark_written(lanes, I);
+			mark_written(lanes, (uint16_t)(I + 2));
+			pc += 2;
+			break;
+		}
+
+		case OP_FX3A: // FX3A: Sets the pitch of the audio pattern to VX
+			lanes->pitch[lane] = VX;
+			pc += 2;
+			break;
+
+		case OP_FX55: // FX55: Stores V0 to VX in memory starting at address I
+			for (uint8_t i = 0; i <= instruction->x; i++)
+			{
+				memory[(uint16_t)(I + i)] = V(i);
+				mark_written(lanes, (uint16_t)(I + i));
+			}
+			if (QUIRK(LOAD_STORE_I))
+				I += instruction->x + 1;
+			pc += 2;
+			break;
+
+		case OP_FX65: // FX65: Fills V0 to VX with values from memory starting at address I
+			for (uint8_t i = 0; i <= instruction->x; i++)
+				V(i) = memory[(uint16_t)(I + i)];
+			if (QUIRK(LOAD_STORE_I))
+				I += instruction->x + 1;
+			pc += 2;
+			break;
+
+		case OP_FX75: // FX75: Stores V0 to VX in the user flags
+			for (uint8_t i = 0; i <= instruction->x; i++)
+				lanes->flags[lane][i] = V(i);
+			pc += 2;
+			break;
+
+		case OP_FX85: // FX85: Fills V0 to VX with the user flags
+			for (uint8_t i = 0; i <= instruction->x; i++)
+				V(i) = lanes->flags[lane][i];
+			pc += 2;
+			break;
+	}
+
+#undef V
+#undef VX
+#undef VY
+#undef SKIP_IF
+
+	lanes->program_counter[lane] = pc;
+	lanes->I[lane] = I;
+	lanes->stack_pointer[lane] = sp;
+	return result;
+}
+
+#ifdef CHIPPY_LANES_AVX2
+int32_t LANES_NAME(execute_lanes_avx2)(Chip8Lanes* lanes, const Instruction* instruction, uint32_t mask, uint16_t pc)
+{
+	/*
+	Runs a register instruction in all 32 lanes at once, or returns LANES_NOT_HANDLED if it has to run lane by lane.
+	Results are only stored to the active lanes. Instructions that set VF store it before reading VX and VY
+	again for the result, like the scalar code, so the results are the same when X or Y is F.
+	Skips only run here when the next instruction is 2 bytes long and the same in every lane.
+	*/
+	uint8_t* vx = lanes->V[instruction->x];
+	uint8_t* vy = lanes->V[instruction->y];
+	uint8_t* vf = lanes->V[0xF];
+
+	// Byte i of active is 0xFF when lane i is in mask
+	__m256i mask_bytes = _mm256_shuffle_epi8(_mm256_set1_epi32((int)mask),
+		_mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3));
+	__m256i lane_bits = _mm256_set1_epi64x((long long)0x8040201008040201ULL);
+	__m256i active = _mm256_cmpeq_epi8(_mm256_and_si256(mask_bytes, lane_bits), lane_bits);
+	__m256i ones = _mm256_set1_epi8(1);
+	__m256i all = _mm256_set1_epi8(-1);
+	uint32_t taken;
+
+	// The quirks change the logic and shift forms, leave them to step_lane()
+	if (QUIRK(LOGIC_VF_RESET) && instruction->form >= OP_8XY1 && instruction->form <= OP_8XY3)
+		return LANES_NOT_HANDLED;
+	if (QUIRK(SHIFT_VY) && (instruction->form == OP_8XY6 || instruction->form == OP_8XYE))
+		return LANES_NOT_HANDLED;
+
+#define LOAD(bytes) _mm256_loadu_si256((const __m256i*)(bytes))
+#define STORE(bytes, value) _mm256_storeu_si256((__m256i*)(bytes), _mm256_blendv_epi8(LOAD(bytes), (value), active))
+#define GREATER(a, b) _mm256_andnot_si256(_mm256_cmpeq_epi8((a), (b)), _mm256_cmpeq_epi8(_mm256_max_epu8((a), (b)), (a)))
+#define FLAG(condition) _mm256_and_si256((condition), ones)
+#define SKIP_IF(condition) \
+	if (code_written(lanes, pc + 2) || CHIP8_SKIP_LENGTH(lanes->memory[0], pc) != 4) \
+		return LANES_NOT_HANDLED; \
+	taken = (uint32_t)_mm256_movemask_epi8(condition) & mask; \
+	if (taken == 0 || taken == mask) \
+		return taken == 0 ? pc + 2 : pc + 4; \
+	set_lanes_word(lanes->program_counter, mask & ~taken, pc + 2); \
+	set_lanes_word(lanes->program_counter, taken, pc + 4); \
+	return LANES_SPLIT
+
+	switch (instruction->form)
+	{
+		case OP_3XNN:
+			SKIP_IF(_mm256_cmpeq_epi8(LOAD(vx), _mm256_set1_epi8((char)instruction->nn)));
+
+		case OP_4XNN:
+			SKIP_IF(_mm256_xor_si256(_mm256_cmpeq_epi8(LOAD(vx), _mm256_set1_epi8((char)instruction->nn)), all));
+
+		case OP_5XY0:
+			SKIP_IF(_mm256_cmpeq_epi8(LOAD(vx), LOAD(vy)));
+
+		case OP_9XY0:
+			SKIP_IF(_mm256_xor_si256(_mm256_cmpeq_epi8(LOAD(vx), LOAD(vy)), all));
+
+		case OP_6XNN:
+			STORE(vx, _mm256_set1_epi8((char)instruction->nn));
+			break;
+
+		case OP_7XNN:
+			STORE(vx, _mm256_add_epi8(LOAD(vx), _mm256_set1_epi8((char)instruction->nn)));
+			break;
+
+		case OP_8XY0:
+			STORE(vx, LOAD(vy));
+			break;
+
+		case OP_8XY1:
+			STORE(vx, _mm256_or_si256(LOAD(vx), LOAD(vy)));
+			break;
+
+		case OP_8XY2:
+			STORE(vx, _mm256_and_si256(LOAD(vx), LOAD(vy)));
+			break;
+
+		case OP_8XY3:
+			STORE(vx, _mm256_xor_si256(LOAD(vx), LOAD(vy)));
+			break;
+
+		case OP_8XY4: // Carry when VY > 0xFF - VX
+			STORE(vf, FLAG(GREATER(LOAD(vy), _mm256_sub_epi8(all, LOAD(vx)))));
+			STORE(vx, _mm256_add_epi8(LOAD(vx), LOAD(vy)));
+			break;
+
+		case OP_8XY5:
+			STORE(vf, FLAG(_mm256_xor_si256(GREATER(LOAD(vy), LOAD(vx)), all)));
+			STORE(vx, _mm256_sub_epi8(LOAD(vx), LOAD(vy)));
+			break;
+
+		case OP_8XY6: // There are no 8-bit shifts, shift 16-bit words and clear the bit that came from the neighbour
+			STORE(vf, _mm256_and_si256(LOAD(vx), ones));
+			STORE(vx, _mm256_and_si256(_mm256_srli_epi16(LOAD(vx), 1), _mm256_set1_epi8(0x7F)));
+			break;
+
+		case OP_8XY7:
+			STORE(vf, FLAG(_mm256_xor_si256(GREATER(LOAD(vx), LOAD(vy)), all)));
+			STORE(vx, _mm256_sub_epi8(LOAD(vy), LOAD(vx)));
+			break;
+
+		case OP_8XYE:
+			STORE(vf, _mm256_and_si256(_mm256_srli_epi16(LOAD(vx), 7), ones));
+			STORE(vx, _mm256_add_epi8(LOAD(vx), LOAD(vx)));
+			break;
+
+		case OP_FX07:
+			STORE(vx, LOAD(lanes->delay_timer));
+			break;
+
+		case OP_FX15:
+			STORE(lanes->delay_timer, LOAD(vx));
+			break;
+
+		case OP_FX18:
+			STORE(lanes->sound_timer, LOAD(vx));
+			break;
+
+		default:
+			return LANES_NOT_HANDLED;
+	}
+
+#undef LOAD
+#undef STORE
+#undef GREATER
+#undef FLAG
+#undef SKIP_IF
+
+	return pc + 2;
+}
+#endif
+
+#undef QUIRK
+
+#undef LANES_NAME
+#undef CORE_QUIRKS
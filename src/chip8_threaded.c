@@ -0,0 +1,67 @@
+#include "chip8.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(CHIPPY_THREADED_CORE) && !defined(__GNUC__) && !defined(__clang__)
+#error "CHIPPY_THREADED_CORE needs computed goto, build it with GCC or Clang"
+#endif
+
+/*
+Batched interpreter loop.
+
+emulate_cycles() runs up to budget instructions in one call and keeps the program counter, I and
+the stack pointer in locals for the whole batch, they are only written back to the chip when it
+returns or before calling into code that reads them from the chip.
+
+Every opcode form is a case of one flat switch. With CHIPPY_THREADED_CORE each case also gets a
+label and instructions end by jumping straight to the label of the next one (threaded code), which
+gives every form its own indirect branch for the branch predictor to work with.
+
+The behaviour has to stay identical to running emulate() budget times, including the decode cache.
+The timers are left to emulate_frame().
+
+The loop itself is in chip8_core.h and is compiled once for every quirk profile, emulate_cycles()
+only picks the loop of the chip's profile.
+*/
+
+// Function prototypes
+ExitReason emulate_cycles_modern(Chip8* chip, uint32_t budget);
+ExitReason emulate_cycles_cosmac(Chip8* chip, uint32_t budget);
+ExitReason emulate_cycles_schip(Chip8* chip, uint32_t budget);
+ExitReason emulate_cycles_xochip(Chip8* chip, uint32_t budget);
+
+ExitReason emulate_cycles(Chip8* chip, uint32_t budget)
+{
+	switch (chip->quirks)
+	{
+		case QUIRKS_COSMAC:
+			return emulate_cycles_cosmac(chip, budget);
+
+		case QUIRKS_SCHIP:
+			return emulate_cycles_schip(chip, budget);
+
+		case QUIRKS_XOCHIP:
+			return emulate_cycles_xochip(chip, budget);
+
+		default:
+			return emulate_cycles_modern(chip, budget);
+	}
+}
+
+#define CORE_NAME emulate_cycles_modern
+#define CORE_QUIRKS QUIRKS_MODERN_FLAGS
+#include "chip8_core.h"
+
+#define CORE_NAME emulate_cycles_cosmac
+#define CORE_QUIRKS QUIRKS_COSMAC_FLAGS
+#include "chip8_core.h"
+
+#define CORE_NAME emulate_cycles_schip
+#define CORE_QUIRKS QUIRKS_SCHIP_FLAGS
+#include "chip8_core.h"
+
+#define CORE_NAME emulate_cycles_xochip
+#define CORE_QUIRKS QUIRKS_XOCHIP_FLAGS
+#include "chip8_core.h"
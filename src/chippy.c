@@ -1,30 +1,137 @@
 #include <SDL.h>
 #include <stdio.h>
-#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "audio.h"
 #include "chip8.h"
+#include "chip8_jit.h"
+#include "display.h"
+#include "frame_pacer.h"
+#include "keymap.h"
+#include "latency.h"
+#include "movie.h"
+#include "rewind.h"
+#include "savestate.h"
+
+#define CHIPPY_MAX_REWIND_SECONDS 3600
+#define CHIPPY_REWIND_FRAME_BYTES 256
 
 // Function prototypes
-int initialize_sdl(int screen_width, int screen_height);
+int initialize_sdl(int scale);
 void destroy_sdl();
 void render(Chip8* chip);
-void put_pixel(int x, int y, Uint32 pixel);
+void handle_event(SDL_Event e, Chip8* chip);
 void debug_keys(Chip8* chip);
 
-SDL_Window* window = NULL;
-SDL_Surface* window_surface = NULL;
-SDL_Surface* render_surface = NULL;
+Display display;
+Audio audio;
+Keymap keymap;
+
+// Times key presses to the frame that answers them with --latency, the histogram is printed at exit
+LatencyTracer latency;
+Uint8 trace_latency = 0;
+
+// Quick save slot, F5 saves and F9 loads
+Uint8 quick_state[CHIP8_STATE_MAX_SIZE];
+size_t quick_state_size = 0;
+
+// Steps back one emulated frame per displayed frame while backspace is held
+Uint8 rewinding = 0;
+
+// The input being recorded with --record. A movie can't go back in time, loading states and rewinding are off while recording
+Movie* movie = NULL;
 
 int resolution_scale = 10;
 
 int main(int argc, char* argv[])
 {
-	if (initialize_sdl(64 * resolution_scale, 32 * resolution_scale) > 0)
+	if (initialize_sdl(resolution_scale) > 0)
 	{
 		return 1;
 	}
 
-	char* rom_name = argv[1];
+	char* rom_name = NULL;
+	int cycles_per_frame = 0;
+	int speed = 1;			// Emulated frames per displayed frame
+	Uint8 show_stats = 0;
+	Uint8 present_every_draw = 0;	// Present after every sprite draw instead of once per frame
+	Uint8 audio_clock = 1;			// Pace the frames by the audio device instead of the performance counter alone
+	int rewind_seconds = 60;		// Emulated seconds of rewind history, 0 to turn it off
+	Uint32 seed = (Uint32)time(NULL);	// Seed for CXNN, a fixed seed makes every run with the same input the same
+	char* movie_name = NULL;
+	int quirks = QUIRKS_MODERN;
+	char* keymap_name = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+			cycles_per_frame = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+			speed = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = (Uint32)strtoul(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			movie_name = argv[++i];
+		else if (strcmp(argv[i], "--keymap") == 0 && i + 1 < argc)
+			keymap_name = argv[++i];
+		else if (strcmp(argv[i], "--rewind") == 0 && i + 1 < argc)
+			rewind_seconds = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--stats") == 0)
+			show_stats = 1;
+		else if (strcmp(argv[i], "--latency") == 0)
+			trace_latency = 1;
+		else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc)
+		{
+			quirks = find_quirk_profile(argv[++i]);
+			if (quirks < 0)
+			{
+				printf("Unknown quirk profile: %s, expected modern, cosmac, schip or xochip \n", argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--present") == 0 && i + 1 < argc)
+		{
+			char* mode = argv[++i];
+			if (strcmp(mode, "draw") == 0)
+				present_every_draw = 1;
+			else if (strcmp(mode, "frame") == 0)
+				present_every_draw = 0;
+			else
+			{
+				printf("Unknown present mode: %s, expected draw or frame \n", mode);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--sync") == 0 && i + 1 < argc)
+		{
+			char* clock = argv[++i];
+			if (strcmp(clock, "audio") == 0)
+				audio_clock = 1;
+			else if (strcmp(clock, "video") == 0)
+				audio_clock = 0;
+			else
+			{
+				printf("Unknown sync mode: %s, expected audio or video \n", clock);
+				return 1;
+			}
+		}
+		else
+			rom_name = argv[i];
+	}
+
+	if (rom_name == NULL)
+	{
+		printf("Usage: chippy <rom> [--cycles instructions_per_frame] [--speed frames_per_frame] [--stats] [--latency] [--present draw|frame] [--sync audio|video] [--rewind seconds] [--seed N] [--record movie] [--keymap file] [--quirks modern|cosmac|schip|xochip] \n");
+		return 1;
+	}
+
+	default_keymap(&keymap);
+	if (keymap_name != NULL && load_keymap(&keymap, keymap_name) != 0)
+	{
+		return 1;
+	}
 
 	Chip8* chip = create_chip();
 	if (chip == NULL)
@@ -32,20 +139,55 @@ int main(int argc, char* argv[])
 		return 1;
 	}
 
+	if (cycles_per_frame > 0)
+		chip->cycles_per_frame = cycles_per_frame;
+
+	seed_chip(chip, seed);
+	set_quirk_profile(chip, (QuirkProfile)quirks);
+
 	if (load_rom(chip, rom_name) != 0)
 	{
 		return 1;
 	}
 
+#ifdef CHIPPY_JIT
+	// emulate_frame() falls back to the interpreter if the recompiler isn't available
+	create_jit(chip);
+#endif
+
+	if (movie_name != NULL)
+	{
+		movie = create_movie(chip);
+		if (movie == NULL)
+			return 1;
+	}
+
+	// A ROM drawing noise every frame measured about 150 bytes a frame in low resolution and 200 in high, most take under 100.
+	// The limit, 55 MB, keeps the sizes far from overflowing, rewind.c reports a history that comes out shorter
+	Rewind* rewind = NULL;
+	if (rewind_seconds > CHIPPY_MAX_REWIND_SECONDS)
+	{
+		printf("Rewinding is limited to %d seconds \n", CHIPPY_MAX_REWIND_SECONDS);
+		rewind_seconds = CHIPPY_MAX_REWIND_SECONDS;
+	}
+
+	if (rewind_seconds > 0 && movie == NULL)
+	{
+		rewind = create_rewind((uint32_t)rewind_seconds * 60, (uint32_t)rewind_seconds * 60 * CHIPPY_REWIND_FRAME_BYTES);
+		if (rewind != NULL)
+			record_frame(rewind, chip);
+	}
+
+	init_tracer(&latency);
+
 	SDL_Event e;
 	Uint8 running = 1;
-	Uint32 start_ticks = 0;
+	ExitReason reason = EXIT_BUDGET_EXHAUSTED;		// How the last emulated frame ended
+	FramePacer pacer;
+	init_pacer(&pacer, 60);
 
 	while (running > 0)
 	{
-		//set_ticks(timer);
-		start_ticks = SDL_GetTicks();
-
 		// Handle the events in the event queue
 		while (SDL_PollEvent(&e) != 0)
 		{
@@ -62,27 +204,74 @@ int main(int argc, char* argv[])
 			handle_event(e, chip);
 		}
 
-		emulate(chip);
-
-		if (chip->sound_timer == 1)
+		// Run the emulated frames. By default the draws are gathered and presented once below,
+		// so half drawn frames are never shown
+		if (rewinding && rewind != NULL)
+			rewind_frame(rewind, chip);
+		else
 		{
-			printf("Awesome sound effect! \n");
+			for (int frame = 0; frame < speed; frame++)
+			{
+				if (movie != NULL)
+					record_movie_keys(movie, chip);
+
+				while ((reason = emulate_frame(chip)) == EXIT_FRAME_DRAWN)
+				{
+					if (present_every_draw)
+						render(chip);
+				}
+
+				if (movie != NULL)
+					record_movie_frame(movie, chip);
+
+				if (rewind != NULL)
+					record_frame(rewind, chip);
+			}
 		}
 
+		// One displayed frame of sound, whatever the speed
+		queue_audio_frame(&audio, chip);
+
 		if (chip->redraw > 0)
 		{
 			render(chip);
-			SDL_UpdateWindowSurface(window);
 		}
 
-		Uint32 ticks = SDL_GetTicks() - start_ticks;
-		
-		Uint32 sleep_time = 8 - ticks;
+		// A ROM that idles with both timers at 0 can only be woken up by a key, sleep until there is an event
+		// instead of waking up for every frame
+		if ((reason == EXIT_IDLE || reason == EXIT_WAITING_FOR_KEY) && chip->delay_timer == 0 && chip->sound_timer == 0 && !rewinding)
+		{
+			pause_audio(&audio);
+			SDL_WaitEvent(NULL);
+			init_pacer(&pacer, 60);
+		}
+		else
+		{
+			// The device plays the samples of a frame in exactly 1/60 s of its own clock, the rate keeps the frames in step with it
+			if (audio_clock)
+				set_pacer_rate(&pacer, audio_rate(&audio));
+
+			wait_for_next_frame(&pacer);
+		}
+
+		// Once a second
+		if (show_stats && pacer.frames == 60)
+		{
+			print_pacer_stats(&pacer);
+			print_audio_stats(&audio);
+		}
+	}
 
-		if (sleep_time < 16)
-			SDL_Delay(sleep_time);
+	if (trace_latency)
+		print_latency_histogram(&latency, chip);
 
-		 // printf("Ticks: %d \n", sleep_time);
+	if (rewind != NULL)
+		destroy_rewind(rewind);
+
+	if (movie != NULL)
+	{
+		save_movie(movie, chip, movie_name);
+		destroy_movie(movie);
 	}
 
 	destroy_chip(chip);
@@ -93,111 +282,81 @@ int main(int argc, char* argv[])
 
 void render(Chip8* chip)
 {
-	for (int i = 0; i < 2048; i++)
-	{
-		Uint32 color;
-		if (chip->display_buffer[i] == 0)
-			color = SDL_MapRGB(window_surface->format, 0, 0, 0);
-		else
-			color = SDL_MapRGB(window_surface->format, 255, 255, 255);
-
-		int x = i % 64;
-		int y = floor(i / 64);
+	update_display(&display, &chip->display_buffer);
+	present_display(&display);
 
-		// x, y , w, h
-		SDL_Rect fillRect = { x * resolution_scale, y * resolution_scale, 10, 10 };
-		SDL_FillRect(window_surface, &fillRect, color);
-	}
+	if (trace_latency)
+		trace_present(&latency, chip);
 
 	chip->redraw = 0;
 }
 
-void debug_keys(Chip8* chip)
+void handle_event(SDL_Event e, Chip8* chip)
 {
-	if (chip->key_state[0] == 1)
-		printf("Key: 1");
-
-	if (chip->key_state[1] == 1)
-		printf("Key: 2");
-
-	if (chip->key_state[2] == 1)
-		printf("Key: 3");
-
-	if (chip->key_state[3] == 1)
-		printf("Key: 4");
-
-	if (chip->key_state[4] == 1)
-		printf("Key: 5");
-
-	if (chip->key_state[5] == 1)
-		printf("Key: 6");
-
-	if (chip->key_state[6] == 1)
-		printf("Key: 7");
-
-	if (chip->key_state[7] == 1)
-		printf("Key: 8");
-
-	if (chip->key_state[8] == 1)
-		printf("Key: q");
-
-	if (chip->key_state[9] == 1)
-		printf("Key: w");
-
-	if (chip->key_state[10] == 1)
-		printf("Key: e");
-
-	if (chip->key_state[11] == 1)
-		printf("Key: r");
-
-	if (chip->key_state[12] == 1)
-		printf("Key: t");
+	// A key was pushed or released
+	if ((e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) && e.key.repeat == 0)
+	{
+		Uint8 down = e.type == SDL_KEYDOWN;
 
-	if (chip->key_state[13] == 1)
-		printf("Key: y");
+		// Mapped scancodes are keypad keys, even the ones that would be hotkeys otherwise
+		Sint8 key = keymap.keys[e.key.keysym.scancode];
+		if (key >= 0)
+		{
+			if (down && trace_latency)
+				trace_key_press(&latency, chip, (Uint8)key);
 
-	if (chip->key_state[14] == 1)
-		printf("Key: u");
+			set_key(chip, (Uint8)key, down);
+			return;
+		}
 
-	if (chip->key_state[15] == 1)
-		printf("Key: i");
+		switch (e.key.keysym.sym)
+		{
+			case SDLK_F5:
+				if (down)
+					quick_state_size = save_state(chip, quick_state, sizeof(quick_state));
+				break;
+			case SDLK_BACKSPACE:
+				rewinding = down;
+				break;
+			case SDLK_F9:
+				if (down && quick_state_size > 0 && movie == NULL)
+					load_state(chip, quick_state, quick_state_size);
+				break;
+			default:
+				break;
+		}
+	}
 }
 
-void put_pixel(int x, int y, Uint32 pixel_value)
+void debug_keys(Chip8* chip)
 {
-	Uint32 *pixels = (Uint32*)window_surface->pixels;
-	pixels[(y * window_surface->w) + x] = pixel_value;
+	for (int i = 0; i < 16; i++)
+	{
+		if (chip->keys >> i & 1)
+			printf("Key: %X", i);
+	}
 }
 
-int initialize_sdl(int screen_width, int screen_height)
+int initialize_sdl(int scale)
 {
 	if (SDL_Init(SDL_INIT_EVERYTHING) < 0)
 	{
 		printf("SDL could not be initialized! SDL_Error: %s\n", SDL_GetError());
 		return 1;
 	}
-	else
-	{
-		window = SDL_CreateWindow("Chippy", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, screen_width, screen_height, SDL_WINDOW_SHOWN);
-		if (window == NULL)
-		{
-			printf("A window could not be created! SDL_Error: %s\n", SDL_GetError());
-			return 1;
-		}
-	}
 
-	window_surface = SDL_GetWindowSurface(window);
-	if (window_surface == NULL)
-	{
-		printf("A window surface could not be created! SDL_Error: %s\n", SDL_GetError());
+	if (create_display(&display, "Chippy", scale) != 0)
 		return 1;
-	}
+
+	// Without sound the emulator still runs
+	open_audio(&audio);
 
 	return 0;
 }
 
 void destroy_sdl()
 {
-	SDL_DestroyWindow(window);
+	close_audio(&audio);
+	destroy_display(&display);
 	SDL_Quit();
 }
@@ -0,0 +1,628 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "chip8.h"
+#include "chip8_jit.h"
+#include "chip8_lanes.h"
+#include "host_thread.h"
+#include "mapped_file.h"
+#include "movie.h"
+#include "rom_pack.h"
+
+/*
+Runs ROMs without a window, input or pacing and prints hashes of the display, for regression runs on machines without a display.
+Every ROM gets its own chip and runs for the requested number of emulated frames as fast as the host allows.
+Each output line is the ROM, the number of frames run so far and the 64-bit FNV-1a hash of the display at that point.
+With --batch the instances are spread over a pool of worker threads instead and only the final hash of each is printed.
+With --lanes N every ROM runs as N instances in lockstep, see chip8_lanes.c, and the final hash of every lane is printed.
+With --replay the movies recorded by chippy --record are replayed on the worker threads instead and checked against the
+state hashes they hold, the ROMs on the command line are only used to find the one each movie was recorded with.
+ROM files are mapped, not read, and with --pack the ROMs are looked up in a ROM pack first, see rom_pack.c.
+Every instance of a ROM loads it from the same mapping.
+*/
+
+typedef struct {
+	char* name;
+	const uint8_t* data;			// Points into the mapped ROM file or the mapped pack
+	size_t size;
+	uint64_t hash;					// Chip8.rom_hash after loading it
+	uint32_t cycles_per_frame;		// From the pack, 0 for the default
+	uint8_t quirks;					// QuirkProfile, from --quirks or the pack
+	uint8_t mapped;					// 1 if file is a mapping of its own, 0 for a ROM from the pack
+	MappedFile file;
+} RomImage;
+
+// Every ROM a run uses, each file is only mapped once
+typedef struct {
+	RomImage* images;
+	int count;
+	RomPack* pack;					// --pack, NULL without one
+	int quirks;						// --quirks, -1 to use the pack's profile for its ROMs and QUIRKS_MODERN for the rest
+} RomSet;
+
+// Function prototypes
+int run_rom(const RomImage* rom, uint32_t frames, uint32_t cycles_per_frame, uint32_t hash_every, uint32_t seed);
+int run_rom_lanes(const RomImage* rom, uint32_t lane_count, uint32_t frames, uint32_t cycles_per_frame, uint32_t seed);
+int run_roms_batched(RomSet* roms, char** rom_names, int rom_count, const char* list_name, uint32_t instances, uint32_t frames, uint32_t cycles_per_frame, int threads, uint32_t seed);
+int add_job(BatchJob** jobs, uint32_t* job_count, uint32_t* job_capacity, const RomImage* rom, uint32_t frames, uint32_t cycles_per_frame, uint32_t seed);
+int run_replays(RomSet* roms, char** rom_names, int rom_count, char** movie_names, int movie_count, const char* list_name, int threads);
+RomImage* find_rom(RomSet* roms, const char* rom_name);
+void free_roms(RomSet* roms);
+
+int main(int argc, char* argv[])
+{
+	uint32_t frames = 600;
+	uint32_t cycles_per_frame = 0;
+	uint32_t hash_every = 0;		// Print a hash every N frames as well as after the last one, 0 for only the last one
+	uint8_t batch = 0;
+	int threads = 0;				// Worker threads for --batch, 0 for one per CPU
+	uint32_t instances = 1;			// Instances of every ROM for --batch
+	uint32_t lane_count = 0;		// Lockstep instances of every ROM for --lanes, 0 to run it on a chip of its own
+	uint32_t seed = CHIP8_DEFAULT_SEED;	// Seed for CXNN, instances and lanes get seed, seed + 1, ...
+	const char* list_name = NULL;
+	const char* replay_list_name = NULL;
+	const char* pack_name = NULL;
+	const char* make_pack_name = NULL;
+	int quirks = -1;
+	char** rom_names = (char**)malloc(sizeof(char*) * argc);
+	char** movie_names = (char**)malloc(sizeof(char*) * argc);
+	int rom_count = 0;
+	int movie_count = 0;
+
+	if (rom_names == NULL || movie_names == NULL)
+		return 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+			cycles_per_frame = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--every") == 0 && i + 1 < argc)
+			hash_every = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--batch") == 0)
+			batch = 1;
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+			instances = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "--lanes") == 0 && i + 1 < argc)
+			lane_count = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			movie_names[movie_count++] = argv[++i];
+		else if (strcmp(argv[i], "--replay-list") == 0 && i + 1 < argc)
+			replay_list_name = argv[++i];
+		else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+			pack_name = argv[++i];
+		else if (strcmp(argv[i], "--make-pack") == 0 && i + 1 < argc)
+			make_pack_name = argv[++i];
+		else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc)
+		{
+			quirks = find_quirk_profile(argv[++i]);
+			if (quirks < 0)
+			{
+				printf("Unknown quirk profile %s, use modern, cosmac, schip or xochip \n", argv[i]);
+				free(rom_names);
+				free(movie_names);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--list") == 0 && i + 1 < argc)
+		{
+			list_name = argv[++i];
+			batch = 1;
+		}
+		else
+			rom_names[rom_count++] = argv[i];
+	}
+
+	if (make_pack_name != NULL && rom_count > 0)
+	{
+		int status = build_rom_pack(make_pack_name, rom_names, rom_count, cycles_per_frame, quirks >= 0 ? (QuirkProfile)quirks : QUIRKS_MODERN);
+		if (status == 0)
+			printf("%d ROMs packed into %s \n", rom_count, make_pack_name);
+
+		free(rom_names);
+		free(movie_names);
+		return status;
+	}
+
+	RomSet roms = { NULL, 0, NULL, quirks };
+	if (pack_name != NULL)
+	{
+		roms.pack = open_rom_pack(pack_name);
+		if (roms.pack == NULL)
+		{
+			free(rom_names);
+			free(movie_names);
+			return 1;
+		}
+
+		// Without ROMs on the command line or a job list every ROM in the pack runs
+		if (rom_count == 0 && list_name == NULL && roms.pack->rom_count > 0)
+		{
+			char** grown = (char**)realloc(rom_names, sizeof(char*) * roms.pack->rom_count);
+			if (grown != NULL)
+			{
+				rom_names = grown;
+				for (uint32_t i = 0; i < roms.pack->rom_count; i++)
+					rom_names[i] = (char*)roms.pack->roms[i].name;
+				rom_count = (int)roms.pack->rom_count;
+			}
+		}
+	}
+
+	if ((rom_count == 0 && list_name == NULL) || (rom_count == 0 && (movie_count > 0 || replay_list_name != NULL)))
+	{
+		printf("Usage: chippy_headless <rom>... [--frames N] [--cycles instructions_per_frame] [--every N] [--seed N] \n");
+		printf("       chippy_headless --batch <rom>... [--instances N] [--threads N] [--list file] [--frames N] [--cycles instructions_per_frame] [--seed N] \n");
+		printf("       chippy_headless --lanes N <rom>... [--frames N] [--cycles instructions_per_frame] [--seed N] \n");
+		printf("       chippy_headless --replay <movie> [--replay <movie>]... [--replay-list file] [--threads N] <rom>... \n");
+		printf("       chippy_headless --make-pack <pack> <rom>... [--cycles instructions_per_frame] [--quirks profile] \n");
+		printf("Every mode takes --pack <pack> to look the ROMs up in a ROM pack, without ROMs or --list every ROM in the pack runs \n");
+		printf("Every mode takes --quirks modern|cosmac|schip|xochip, ROMs from a pack run with the pack's profile otherwise \n");
+		free_roms(&roms);
+		free(rom_names);
+		free(movie_names);
+		return 1;
+	}
+
+	int failed = 0;
+	if (movie_count > 0 || replay_list_name != NULL)
+		failed = run_replays(&roms, rom_names, rom_count, movie_names, movie_count, replay_list_name, threads);
+	else if (batch)
+		failed = run_roms_batched(&roms, rom_names, rom_count, list_name, instances, frames, cycles_per_frame, threads, seed);
+	else
+	{
+		for (int i = 0; i < rom_count; i++)
+		{
+			RomImage* rom = find_rom(&roms, rom_names[i]);
+			int result = rom == NULL;
+			if (rom != NULL)
+			{
+				result = lane_count > 0
+					? run_rom_lanes(rom, lane_count, frames, cycles_per_frame, seed)
+					: run_rom(rom, frames, cycles_per_frame, hash_every, seed);
+			}
+
+			if (result != 0)
+				failed = 1;
+		}
+	}
+
+	free_roms(&roms);
+	free(rom_names);
+	free(movie_names);
+	return failed;
+}
+
+int run_rom(const RomImage* rom, uint32_t frames, uint32_t cycles_per_frame, uint32_t hash_every, uint32_t seed)
+{
+	Chip8* chip = create_chip();
+	if (chip == NULL)
+	{
+		return 1;
+	}
+
+	if (cycles_per_frame > 0)
+		chip->cycles_per_frame = cycles_per_frame;
+	else if (rom->cycles_per_frame > 0)
+		chip->cycles_per_frame = rom->cycles_per_frame;
+
+	seed_chip(chip, seed);
+	set_quirk_profile(chip, (QuirkProfile)rom->quirks);
+
+	if (load_program(chip, rom->data, rom->size) != 0)
+	{
+		destroy_chip(chip);
+		return 1;
+	}
+
+#ifdef CHIPPY_JIT
+	create_jit(chip);
+#endif
+
+	for (uint32_t frame = 1; frame <= frames; frame++)
+	{
+		// Draws don't need to be shown, just run the frame to the end
+		while (emulate_frame(chip) == EXIT_FRAME_DRAWN)
+			;
+
+		if (frame == frames || (hash_every > 0 && frame % hash_every == 0))
+			printf("%s %u %016llx\n", rom->name, frame, (unsigned long long)display_hash(chip));
+	}
+
+	destroy_chip(chip);
+	return 0;
+}
+
+int run_rom_lanes(const RomImage* rom, uint32_t lane_count, uint32_t frames, uint32_t cycles_per_frame, uint32_t seed)
+{
+	Chip8Lanes* lanes = create_lanes(lane_count);
+	if (lanes == NULL || load_lanes_program(lanes, rom->data, rom->size) != 0)
+	{
+		if (lanes != NULL)
+			destroy_lanes(lanes);
+		return 1;
+	}
+
+	if (cycles_per_frame > 0)
+		lanes->cycles_per_frame = cycles_per_frame;
+	else if (rom->cycles_per_frame > 0)
+		lanes->cycles_per_frame = rom->cycles_per_frame;
+
+	lanes->quirks = rom->quirks;
+
+	for (uint32_t lane = 0; lane < lane_count; lane++)
+		seed_lane(lanes, lane, seed + lane);
+
+	double start = host_seconds();
+	for (uint32_t frame = 1; frame <= frames; frame++)
+		emulate_lanes_frame(lanes);
+	double seconds = host_seconds() - start;
+
+	// The hashes are taken from a chip that every lane is copied into in turn
+	Chip8* chip = create_chip();
+	if (chip == NULL)
+	{
+		destroy_lanes(lanes);
+		return 1;
+	}
+
+	uint64_t total_cycles = 0;
+	for (uint32_t lane = 0; lane < lane_count; lane++)
+	{
+		copy_lane(lanes, lane, chip);
+		printf("%s#%u %u %016llx\n", rom->name, lane, frames, (unsigned long long)display_hash(chip));
+		total_cycles += lanes->cycles[lane];
+	}
+
+	fprintf(stderr, "%u lanes in %.3f s, %.0f instructions/s, %.2f lanes per step \n",
+		lane_count, seconds, total_cycles / seconds, lanes->steps > 0 ? (double)total_cycles / lanes->steps : 0.0);
+
+	destroy_chip(chip);
+	destroy_lanes(lanes);
+	return 0;
+}
+
+int run_roms_batched(RomSet* roms, char** rom_names, int rom_count, const char* list_name, uint32_t instances, uint32_t frames, uint32_t cycles_per_frame, int threads, uint32_t seed)
+{
+	/*
+	Every ROM on the command line gets instances jobs. Every line of the list file is one more job,
+	"<rom> [frames] [cycles_per_frame]", so each instance can have its own frame budget.
+	Every ROM file is only mapped once no matter how many instances run it.
+	*/
+	BatchJob* jobs = NULL;
+	uint32_t job_count = 0;
+	uint32_t job_capacity = 0;
+	int failed = 0;
+
+	for (int i = 0; i < rom_count && !failed; i++)
+	{
+		RomImage* rom = find_rom(roms, rom_names[i]);
+		failed = rom == NULL;
+
+		for (uint32_t instance = 0; instance < instances && !failed; instance++)
+			failed = add_job(&jobs, &job_count, &job_capacity, rom, frames, cycles_per_frame, seed);
+	}
+
+	if (list_name != NULL && !failed)
+	{
+		FILE* list = fopen(list_name, "r");
+		if (list == NULL)
+		{
+			printf("Could not open the job list: %s \n", list_name);
+			failed = 1;
+		}
+		else
+		{
+			char line[1024];
+			while (!failed && fgets(line, sizeof(line), list) != NULL)
+			{
+				char rom_name[1024];
+				unsigned int line_frames = frames;
+				unsigned int line_cycles = cycles_per_frame;
+
+				if (sscanf(line, "%1023s %u %u", rom_name, &line_frames, &line_cycles) < 1 || rom_name[0] == '#')
+					continue;
+
+				RomImage* rom = find_rom(roms, rom_name);
+				failed = rom == NULL || add_job(&jobs, &job_count, &job_capacity, rom, line_frames, line_cycles, seed);
+			}
+
+			fclose(list);
+		}
+	}
+
+	BatchStats stats;
+	if (!failed && job_count > 0)
+		failed = run_batch(jobs, job_count, threads, &stats);
+
+	if (!failed && job_count > 0)
+	{
+		uint64_t total_frames = 0;
+		uint64_t total_cycles = 0;
+
+		for (uint32_t j = 0; j < job_count; j++)
+		{
+			if (jobs[j].status != 0)
+			{
+				printf("%s failed \n", jobs[j].rom_name);
+				failed = 1;
+				continue;
+			}
+
+			printf("%s %u %016llx\n", jobs[j].rom_name, jobs[j].frames, (unsigned long long)jobs[j].display_hash);
+			total_frames += jobs[j].frames;
+			total_cycles += jobs[j].cycles;
+		}
+
+		fprintf(stderr, "%u instances on %d threads in %.3f s, %.0f frames/s, %.0f instructions/s, %u steals \n",
+			job_count, stats.workers, stats.seconds, total_frames / stats.seconds, total_cycles / stats.seconds, stats.steals);
+	}
+
+	free(jobs);
+	return failed;
+}
+
+int add_job(BatchJob** jobs, uint32_t* job_count, uint32_t* job_capacity, const RomImage* rom, uint32_t frames, uint32_t cycles_per_frame, uint32_t seed)
+{
+	// Appends a job for the ROM, the job shares the ROM's name and data
+	if (*job_count == *job_capacity)
+	{
+		uint32_t capacity = *job_capacity > 0 ? *job_capacity * 2 : 64;
+		BatchJob* grown = (BatchJob*)realloc(*jobs, sizeof(BatchJob) * capacity);
+		if (grown == NULL)
+			return 1;
+		*jobs = grown;
+		*job_capacity = capacity;
+	}
+
+	BatchJob* job = &(*jobs)[(*job_count)++];
+	memset(job, 0, sizeof(BatchJob));
+	job->rom_name = rom->name;
+	job->program = rom->data;
+	job->program_size = rom->size;
+	job->frames = frames;
+	job->cycles_per_frame = cycles_per_frame > 0 ? cycles_per_frame : rom->cycles_per_frame;
+	job->quirks = rom->quirks;
+	job->seed = seed + *job_count - 1;
+
+	return 0;
+}
+
+int run_replays(RomSet* roms, char** rom_names, int rom_count, char** movie_names, int movie_count, const char* list_name, int threads)
+{
+	/*
+	Every movie on the command line and every line of the list file is replayed on the ROM it was recorded with.
+	Prints the movie, the frames, the display hash and whether the state matched at every checkpoint of the movie.
+	*/
+	char** names = NULL;
+	Movie** movies = NULL;
+	BatchJob* jobs = NULL;
+	uint32_t count = 0;
+	uint32_t capacity = 0;
+	int failed = 0;
+
+	for (int r = 0; r < rom_count && !failed; r++)
+		failed = find_rom(roms, rom_names[r]) == NULL;
+
+	FILE* list = NULL;
+	if (list_name != NULL && !failed)
+	{
+		list = fopen(list_name, "r");
+		if (list == NULL)
+		{
+			printf("Could not open the replay list: %s \n", list_name);
+			failed = 1;
+		}
+	}
+
+	// The movies from the command line come first, then the ones from the list
+	char line[1024];
+	char list_movie_name[1024];
+	for (int i = 0; !failed; i++)
+	{
+		const char* movie_name = NULL;
+		if (i < movie_count)
+			movie_name = movie_names[i];
+		else if (list != NULL && fgets(line, sizeof(line), list) != NULL)
+		{
+			if (sscanf(line, "%1023s", list_movie_name) < 1 || list_movie_name[0] == '#')
+				continue;
+			movie_name = list_movie_name;
+		}
+		else
+			break;
+
+		if (count == capacity)
+		{
+			capacity = capacity > 0 ? capacity * 2 : 64;
+			char** grown_names = (char**)realloc(names, sizeof(char*) * capacity);
+			Movie** grown_movies = (Movie**)realloc(movies, sizeof(Movie*) * capacity);
+			names = grown_names != NULL ? grown_names : names;
+			movies = grown_movies != NULL ? grown_movies : movies;
+			if (grown_names == NULL || grown_movies == NULL)
+			{
+				failed = 1;
+				break;
+			}
+		}
+
+		names[count] = (char*)malloc(strlen(movie_name) + 1);
+		movies[count] = load_movie(movie_name);
+		if (names[count] == NULL || movies[count] == NULL)
+		{
+			free(names[count]);
+			if (movies[count] != NULL)
+				destroy_movie(movies[count]);
+			failed = 1;
+			break;
+		}
+
+		strcpy(names[count], movie_name);
+		count++;
+	}
+
+	if (list != NULL)
+		fclose(list);
+
+	if (!failed && count > 0)
+	{
+		jobs = (BatchJob*)calloc(count, sizeof(BatchJob));
+		failed = jobs == NULL;
+	}
+
+	for (uint32_t m = 0; m < count && !failed; m++)
+	{
+		RomImage* rom = NULL;
+		for (int r = 0; r < roms->count; r++)
+		{
+			if (roms->images[r].hash == movies[m]->rom_hash)
+				rom = &roms->images[r];
+		}
+
+		if (rom == NULL)
+		{
+			printf("None of the ROMs is the one %s was recorded with \n", names[m]);
+			failed = 1;
+			break;
+		}
+
+		jobs[m].rom_name = names[m];
+		jobs[m].program = rom->data;
+		jobs[m].program_size = rom->size;
+		jobs[m].frames = movies[m]->frames;
+		jobs[m].movie = movies[m];
+	}
+
+	BatchStats stats;
+	if (!failed && count > 0)
+		failed = run_batch(jobs, count, threads, &stats);
+
+	if (!failed && count > 0)
+	{
+		uint64_t total_frames = 0;
+		uint32_t mismatches = 0;
+
+		for (uint32_t j = 0; j < count; j++)
+		{
+			if (jobs[j].status == 2)
+			{
+				printf("%s %u %016llx mismatch at frame %u\n", jobs[j].rom_name, jobs[j].frames, (unsigned long long)jobs[j].display_hash, jobs[j].mismatch_frame);
+				mismatches++;
+			}
+			else if (jobs[j].status != 0)
+				printf("%s failed \n", jobs[j].rom_name);
+			else
+				printf("%s %u %016llx ok\n", jobs[j].rom_name, jobs[j].frames, (unsigned long long)jobs[j].display_hash);
+
+			if (jobs[j].status != 0)
+				failed = 1;
+			total_frames += jobs[j].frames;
+		}
+
+		fprintf(stderr, "%u replays on %d threads in %.3f s, %.0f frames/s, %u mismatches \n",
+			count, stats.workers, stats.seconds, total_frames / stats.seconds, mismatches);
+	}
+
+	for (uint32_t m = 0; m < count; m++)
+	{
+		free(names[m]);
+		destroy_movie(movies[m]);
+	}
+
+	free(names);
+	free(movies);
+	free(jobs);
+	return failed;
+}
+
+RomImage* find_rom(RomSet* roms, const char* rom_name)
+{
+	/*
+	Returns the ROM that was already looked up under the name, otherwise the one of that name in the pack,
+	otherwise maps the file. The pointer is only good until the next call, the name and data stay put.
+	*/
+	for (int r = 0; r < roms->count; r++)
+	{
+		if (strcmp(roms->images[r].name, rom_name) == 0)
+			return &roms->images[r];
+	}
+
+	RomImage* grown = (RomImage*)realloc(roms->images, sizeof(RomImage) * (roms->count + 1));
+	if (grown == NULL)
+		return NULL;
+	roms->images = grown;
+
+	RomImage* rom = &roms->images[roms->count];
+	memset(rom, 0, sizeof(RomImage));
+
+	const PackedRom* packed = roms->pack != NULL ? find_packed_rom(roms->pack, rom_name) : NULL;
+	if (packed != NULL)
+	{
+		rom->data = packed->data;
+		rom->size = packed->size;
+		rom->hash = packed->rom_hash;
+		rom->cycles_per_frame = packed->cycles_per_frame;
+		rom->quirks = packed->quirks;
+	}
+	else
+	{
+		if (map_file(&rom->file, rom_name) != 0)
+			return NULL;
+
+		// Loading it once checks it and gives the hash movies are matched by
+		Chip8* probe = create_chip();
+		if (probe == NULL || load_program(probe, rom->file.data, rom->file.size) != 0)
+		{
+			if (probe != NULL)
+				destroy_chip(probe);
+			unmap_file(&rom->file);
+			return NULL;
+		}
+
+		rom->data = rom->file.data;
+		rom->size = rom->file.size;
+		rom->hash = probe->rom_hash;
+		rom->mapped = 1;
+		destroy_chip(probe);
+	}
+
+	if (roms->quirks >= 0)
+		rom->quirks = (uint8_t)roms->quirks;
+
+	rom->name = (char*)malloc(strlen(rom_name) + 1);
+	if (rom->name == NULL)
+	{
+		if (rom->mapped)
+			unmap_file(&rom->file);
+		return NULL;
+	}
+	strcpy(rom->name, rom_name);
+
+	roms->count++;
+	return rom;
+}
+
+void free_roms(RomSet* roms)
+{
+	for (int r = 0; r < roms->count; r++)
+	{
+		if (roms->images[r].mapped)
+			unmap_file(&roms->images[r].file);
+		free(roms->images[r].name);
+	}
+
+	if (roms->pack != NULL)
+		close_rom_pack(roms->pack);
+
+	free(roms->images);
+	roms->images = NULL;
+	roms->count = 0;
+	roms->pack = NULL;
+}
\ No newline at end of file
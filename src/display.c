@@ -0,0 +1,127 @@
+#include "display.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+The display is drawn by expanding the packed rows into an ARGB streaming texture and letting
+SDL_RenderCopy stretch it over the window, so the scaling is done by the renderer (usually on the GPU)
+and a redraw only touches the texels of the current mode. The 64x32 mode fills the top left quarter of
+the 128x64 texture and only that quarter is stretched, so its pixels come out twice as big.
+Every byte of a row is expanded with one copy from a table of pre-expanded pixels that is rebuilt
+whenever the palette changes. Only the words of a row that have pixels on the second XO-CHIP plane
+look their colors up pixel by pixel.
+*/
+
+int create_display(Display* display, const char* title, int scale)
+{
+	memset(display, 0, sizeof(Display));
+
+	display->window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 64 * scale, 32 * scale, SDL_WINDOW_SHOWN);
+	if (display->window == NULL)
+	{
+		printf("A window could not be created! SDL_Error: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	display->renderer = SDL_CreateRenderer(display->window, -1, 0);
+	if (display->renderer == NULL)
+	{
+		printf("A renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	// Nearest neighbour scaling keeps the pixels sharp
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+
+	display->texture = SDL_CreateTexture(display->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, 128, 64);
+	if (display->texture == NULL)
+	{
+		printf("A texture could not be created! SDL_Error: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	set_palette(display, 0xFF000000, 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555);
+	display->width = 64;
+	display->height = 32;
+
+	return 0;
+}
+
+void destroy_display(Display* display)
+{
+	if (display->texture != NULL)
+		SDL_DestroyTexture(display->texture);
+
+	if (display->renderer != NULL)
+		SDL_DestroyRenderer(display->renderer);
+
+	if (display->window != NULL)
+		SDL_DestroyWindow(display->window);
+
+	memset(display, 0, sizeof(Display));
+}
+
+void set_palette(Display* display, Uint32 background, Uint32 first, Uint32 second, Uint32 both)
+{
+	// The colors of a pixel that is set on neither plane, only on the first, only on the second and on both
+	display->palette[0] = background;
+	display->palette[1] = first;
+	display->palette[2] = second;
+	display->palette[3] = both;
+
+	for (int byte = 0; byte < 256; byte++)
+	{
+		for (int bit = 0; bit < 8; bit++)
+			display->expanded[byte][bit] = display->palette[(byte >> (7 - bit)) & 1];
+	}
+}
+
+int update_display(Display* display, const DisplayBuffer* display_buffer)
+{
+	// Expands the rows of the current mode and both planes into the texture
+	void* pixels;
+	int pitch;
+	int words = display_buffer->hires ? 2 : 1;
+
+	display->width = 64 * words;
+	display->height = 32 * words;
+
+	if (SDL_LockTexture(display->texture, NULL, &pixels, &pitch) != 0)
+	{
+		printf("The display texture could not be locked! SDL_Error: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	for (int y = 0; y < display->height; y++)
+	{
+		Uint32* texel = (Uint32*)((Uint8*)pixels + y * pitch);
+
+		for (int word = 0; word < words; word++)
+		{
+			Uint64 row = display_buffer->planes[0][y][word];
+			Uint64 second = display_buffer->planes[1][y][word];
+
+			if (second != 0)
+			{
+				for (int bit = 63; bit >= 0; bit--, texel++)
+					*texel = display->palette[((row >> bit) & 1) | ((second >> bit) & 1) << 1];
+				continue;
+			}
+
+			for (int shift = 56; shift >= 0; shift -= 8, texel += 8)
+				memcpy(texel, display->expanded[(row >> shift) & 0xFF], 8 * sizeof(Uint32));
+		}
+	}
+
+	SDL_UnlockTexture(display->texture);
+
+	return 0;
+}
+
+void present_display(Display* display)
+{
+	SDL_Rect source = { 0, 0, display->width, display->height };
+	SDL_RenderCopy(display->renderer, display->texture, &source, NULL);
+	SDL_RenderPresent(display->renderer);
+}
@@ -0,0 +1,23 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <SDL.h>
+#include "chip8.h"
+
+typedef struct {
+	SDL_Window* window;
+	SDL_Renderer* renderer;
+	SDL_Texture* texture;			// 128x64 ARGB8888 streaming texture, the renderer scales it to the window
+	int width;						// The part of the texture the current mode uses, 64x32 or 128x64
+	int height;
+	Uint32 palette[4];				// ARGB colors of a pixel by its bits, first plane in bit 0 and second plane in bit 1
+	Uint32 expanded[256][8];		// The 8 ARGB pixels for every possible byte of a row that is only drawn on the first plane
+} Display;
+
+int create_display(Display* display, const char* title, int scale);
+void destroy_display(Display* display);
+void set_palette(Display* display, Uint32 background, Uint32 first, Uint32 second, Uint32 both);
+int update_display(Display* display, const DisplayBuffer* display_buffer);
+void present_display(Display* display);
+
+#endif
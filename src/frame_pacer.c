@@ -0,0 +1,91 @@
+#include "frame_pacer.h"
+
+#include <stdio.h>
+
+/*
+SDL_Delay only has millisecond resolution and the OS may oversleep by a millisecond or two, so the
+pacer sleeps until it is spin_ticks away from the deadline and busy waits on the performance
+counter for the rest. Deadlines are absolute, a frame that starts late doesn't push the ones after it.
+*/
+
+#define PACER_SPIN_MS 2
+
+void reset_pacer_stats(FramePacer* pacer);
+
+void init_pacer(FramePacer* pacer, Uint32 frames_per_second)
+{
+	pacer->frequency = SDL_GetPerformanceFrequency();
+	pacer->frames_per_second = frames_per_second;
+	pacer->frame_ticks = pacer->frequency / frames_per_second;
+	pacer->remainder = 0;
+	pacer->spin_ticks = pacer->frequency * PACER_SPIN_MS / 1000;
+	pacer->next_frame = SDL_GetPerformanceCounter() + pacer->frame_ticks;
+	pacer->adjustment_ticks = 0;
+
+	reset_pacer_stats(pacer);
+}
+
+double wait_for_next_frame(FramePacer* pacer)
+{
+	// Waits until the next frame is due and returns how late, in milliseconds, it was reached
+	Uint64 now = SDL_GetPerformanceCounter();
+
+	if (now < pacer->next_frame)
+	{
+		Uint64 remaining = pacer->next_frame - now;
+		if (remaining > pacer->spin_ticks)
+			SDL_Delay((Uint32)((remaining - pacer->spin_ticks) * 1000 / pacer->frequency));
+
+		while ((now = SDL_GetPerformanceCounter()) < pacer->next_frame)
+			;
+	}
+
+	double late_ms = (double)(now - pacer->next_frame) * 1000.0 / pacer->frequency;
+
+	pacer->frames++;
+	pacer->total_late_ms += late_ms;
+	if (late_ms > 1.0)
+		pacer->late_frames++;
+	if (late_ms > pacer->max_late_ms)
+		pacer->max_late_ms = late_ms;
+
+	// More than a whole frame behind (a stall, a window drag...), start over from now instead of rushing to catch up
+	if (now - pacer->next_frame > pacer->frame_ticks)
+		pacer->next_frame = now;
+
+	// Carry the fraction of a tick the frame length was rounded down by, so the rate doesn't drift
+	pacer->next_frame += pacer->frame_ticks + pacer->adjustment_ticks;
+	pacer->remainder += pacer->frequency % pacer->frames_per_second;
+	if (pacer->remainder >= pacer->frames_per_second)
+	{
+		pacer->next_frame++;
+		pacer->remainder -= pacer->frames_per_second;
+	}
+
+	return late_ms;
+}
+
+void set_pacer_rate(FramePacer* pacer, double ratio)
+{
+	// Makes the frames after the next one ratio times as long, to follow a clock other than the performance counter
+	pacer->adjustment_ticks = (Sint64)((ratio - 1.0) * pacer->frame_ticks);
+}
+
+void print_pacer_stats(FramePacer* pacer)
+{
+	if (pacer->frames == 0)
+		return;
+
+	printf("Frames: %u, late: %u, average lateness: %.3f ms, max lateness: %.3f ms \n",
+		pacer->frames, pacer->late_frames, pacer->total_late_ms / pacer->frames, pacer->max_late_ms);
+
+	reset_pacer_stats(pacer);
+}
+
+void reset_pacer_stats(FramePacer* pacer)
+{
+	pacer->frames = 0;
+	pacer->late_frames = 0;
+	pacer->total_late_ms = 0.0;
+	pacer->max_late_ms = 0.0;
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <SDL.h>
+
+typedef struct {
+	Uint64 frequency;				// Performance counter ticks per second
+	Uint64 frame_ticks;				// Whole ticks per frame
+	Uint32 frames_per_second;
+	Uint32 remainder;				// Fractional ticks carried over, in 1/frames_per_second of a tick
+	Uint64 spin_ticks;				// The last stretch before a frame is due is spun instead of slept
+	Uint64 next_frame;				// Counter value the next frame is due at
+	Sint64 adjustment_ticks;		// Added to every frame, see set_pacer_rate()
+
+	Uint32 frames;					// Frames paced since the stats were last reset
+	Uint32 late_frames;				// Frames that started more than a millisecond late
+	double total_late_ms;
+	double max_late_ms;
+} FramePacer;
+
+void init_pacer(FramePacer* pacer, Uint32 frames_per_second);
+double wait_for_next_frame(FramePacer* pacer);
+void set_pacer_rate(FramePacer* pacer, double ratio);
+void print_pacer_stats(FramePacer* pacer);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "host_thread.h"
+
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <time.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+	void (*function)(void*);
+	void* argument;
+} ThreadStart;
+
+#ifdef _WIN32
+DWORD WINAPI thread_entry(LPVOID parameter);
+#else
+void* thread_entry(void* parameter);
+#endif
+
+#ifdef _WIN32
+DWORD WINAPI thread_entry(LPVOID parameter)
+#else
+void* thread_entry(void* parameter)
+#endif
+{
+	// Both thread APIs want their own entry point signature, this one just calls the function start_thread() was given
+	ThreadStart start = *(ThreadStart*)parameter;
+	free(parameter);
+
+	start.function(start.argument);
+	return 0;
+}
+
+int start_thread(HostThread* thread, void (*function)(void*), void* argument)
+{
+	ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+	if (start == NULL)
+		return 1;
+
+	start->function = function;
+	start->argument = argument;
+
+#ifdef _WIN32
+	*thread = CreateThread(NULL, 0, thread_entry, start, 0, NULL);
+	if (*thread == NULL)
+#else
+	if (pthread_create(thread, NULL, thread_entry, start) != 0)
+#endif
+	{
+		free(start);
+		return 1;
+	}
+
+	return 0;
+}
+
+void join_thread(HostThread thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+}
+
+void init_mutex(HostMutex* mutex)
+{
+#ifdef _WIN32
+	InitializeCriticalSection(mutex);
+#else
+	pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void destroy_mutex(HostMutex* mutex)
+{
+#ifdef _WIN32
+	DeleteCriticalSection(mutex);
+#else
+	pthread_mutex_destroy(mutex);
+#endif
+}
+
+void lock_mutex(HostMutex* mutex)
+{
+#ifdef _WIN32
+	EnterCriticalSection(mutex);
+#else
+	pthread_mutex_lock(mutex);
+#endif
+}
+
+void unlock_mutex(HostMutex* mutex)
+{
+#ifdef _WIN32
+	LeaveCriticalSection(mutex);
+#else
+	pthread_mutex_unlock(mutex);
+#endif
+}
+
+int cpu_count()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+#endif
+}
+
+double host_seconds()
+{
+	// Monotonic wall clock time in seconds, for timing batches
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#endif
+}
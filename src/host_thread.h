@@ -0,0 +1,25 @@
+#ifndef HOST_THREAD_H
+#define HOST_THREAD_H
+
+// Just enough threading for the batch runner, on top of Win32 threads or pthreads
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE HostThread;
+typedef CRITICAL_SECTION HostMutex;
+#else
+#include <pthread.h>
+typedef pthread_t HostThread;
+typedef pthread_mutex_t HostMutex;
+#endif
+
+int start_thread(HostThread* thread, void (*function)(void*), void* argument);
+void join_thread(HostThread thread);
+void init_mutex(HostMutex* mutex);
+void destroy_mutex(HostMutex* mutex);
+void lock_mutex(HostMutex* mutex);
+void unlock_mutex(HostMutex* mutex);
+int cpu_count();
+double host_seconds();
+
+#endif
@@ -0,0 +1,88 @@
+#include "keymap.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Keymap files have one mapping per line, the CHIP-8 key as a hex digit followed by the SDL name of the scancode:
+
+	# Keypad on the left, the cabinet's buttons on the right
+	5 Up
+	8 Down
+	7 Left
+	9 Right
+	6 Left Ctrl
+	6 Space
+
+Blank lines and lines starting with # are skipped. A key can have any number of scancodes, and a file replaces the
+default layout completely, so the keys it leaves out are not mapped at all.
+*/
+
+void default_keymap(Keymap* keymap)
+{
+	// 1 to 8 on the top row are the keys 0 to 7 and Q to I below them the keys 8 to F
+	static const SDL_Scancode layout[16] =
+	{
+		SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3, SDL_SCANCODE_4, SDL_SCANCODE_5, SDL_SCANCODE_6, SDL_SCANCODE_7, SDL_SCANCODE_8,
+		SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_R, SDL_SCANCODE_T, SDL_SCANCODE_Y, SDL_SCANCODE_U, SDL_SCANCODE_I
+	};
+
+	memset(keymap->keys, -1, sizeof(keymap->keys));
+
+	for (int key = 0; key < 16; key++)
+		keymap->keys[layout[key]] = (Sint8)key;
+}
+
+int load_keymap(Keymap* keymap, const char* filename)
+{
+	// The keymap is only changed when the whole file is valid
+	FILE* file = fopen(filename, "r");
+	if (file == NULL)
+	{
+		printf("Could not open the keymap: %s \n", filename);
+		return 1;
+	}
+
+	Keymap loaded;
+	memset(loaded.keys, -1, sizeof(loaded.keys));
+
+	char line[256];
+	int number = 0;
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		number++;
+
+		char* start = line;
+		while (isspace((unsigned char)*start))
+			start++;
+
+		char* end = start + strlen(start);
+		while (end > start && isspace((unsigned char)end[-1]))
+			*--end = '\0';
+
+		if (*start == '\0' || *start == '#')
+			continue;
+
+		char* name = start + 1;
+		while (isspace((unsigned char)*name))
+			name++;
+
+		SDL_Scancode scancode = SDL_GetScancodeFromName(name);
+		if (!isxdigit((unsigned char)*start) || !isspace((unsigned char)start[1]) || scancode == SDL_SCANCODE_UNKNOWN)
+		{
+			printf("%s:%d: expected a key from 0 to F and the name of a scancode \n", filename, number);
+			fclose(file);
+			return 1;
+		}
+
+		char digit[2] = { *start, '\0' };
+		loaded.keys[scancode] = (Sint8)strtol(digit, NULL, 16);
+	}
+
+	fclose(file);
+	memcpy(keymap, &loaded, sizeof(Keymap));
+
+	return 0;
+}
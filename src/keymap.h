@@ -0,0 +1,14 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <SDL.h>
+
+// Which CHIP-8 key every scancode presses, by position on the keyboard rather than by the letter on the key
+typedef struct {
+	Sint8 keys[SDL_NUM_SCANCODES];	// Key 0 to F, -1 for the scancodes that aren't mapped
+} Keymap;
+
+void default_keymap(Keymap* keymap);
+int load_keymap(Keymap* keymap, const char* filename);
+
+#endif
@@ -0,0 +1,103 @@
+#include "latency.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+A trace goes through the states of TraceState: trace_key_press() starts it when a key goes down, the core moves it on
+when EX9E, EXA1 or FX0A first reads the key and again when DXYN first draws after that, and trace_present() ends it
+when the frame with that draw has been presented. Present is when SDL_RenderPresent() returns, the display adds its own
+scan out and response time on top of that.
+*/
+
+#define LATENCY_BAR_WIDTH 50
+
+void init_tracer(LatencyTracer* tracer)
+{
+	memset(tracer, 0, sizeof(LatencyTracer));
+	tracer->frequency = SDL_GetPerformanceFrequency();
+}
+
+void trace_key_press(LatencyTracer* tracer, Chip8* chip, uint8_t key)
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+
+	if (chip->trace_state != TRACE_OFF)
+	{
+		// Still waiting on the last press, unless the ROM has had long enough to answer it
+		if (now - tracer->press_time < tracer->frequency * LATENCY_TIMEOUT_MS / 1000)
+			return;
+
+		if (chip->trace_state == TRACE_WAITING_FOR_READ)
+			tracer->unread++;
+		else if (chip->trace_state == TRACE_WAITING_FOR_DRAW)
+			tracer->undrawn++;
+	}
+
+	tracer->press_time = now;
+	tracer->press_cycle = chip->cycles;
+	chip->trace_keys = (uint16_t)(1 << key);
+	chip->trace_state = TRACE_WAITING_FOR_READ;
+}
+
+void trace_present(LatencyTracer* tracer, Chip8* chip)
+{
+	// Called right after a frame was presented, ends the trace if the frame has its draw in it
+	if (chip->trace_state != TRACE_DRAWN)
+		return;
+
+	double ms = (double)(SDL_GetPerformanceCounter() - tracer->press_time) * 1000.0 / tracer->frequency;
+
+	int bucket = (int)(ms / LATENCY_BUCKET_MS);
+	if (bucket >= LATENCY_BUCKETS)
+		bucket = LATENCY_BUCKETS - 1;
+
+	tracer->histogram[bucket]++;
+	tracer->count++;
+	tracer->total_ms += ms;
+	if (ms > tracer->max_ms)
+		tracer->max_ms = ms;
+
+	// Loading a state or rewinding can take the cycle count back past the press
+	if (chip->trace_cycle > tracer->press_cycle)
+		tracer->total_read_cycles += chip->trace_cycle - tracer->press_cycle;
+
+	chip->trace_state = TRACE_OFF;
+}
+
+void print_latency_histogram(LatencyTracer* tracer, const Chip8* chip)
+{
+	if (tracer->count == 0)
+	{
+		printf("Latency: no key press reached the display, unread: %u, undrawn: %u \n", tracer->unread, tracer->undrawn);
+		return;
+	}
+
+	double read_cycles = (double)tracer->total_read_cycles / tracer->count;
+	printf("Latency from key press to present: %u presses, average: %.1f ms, max: %.1f ms \n",
+		tracer->count, tracer->total_ms / tracer->count, tracer->max_ms);
+	printf("Average from key press to the ROM reading it: %.0f instructions, %.2f emulated frames \n",
+		read_cycles, read_cycles / chip->cycles_per_frame);
+
+	Uint32 largest = 0;
+	for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+	{
+		if (tracer->histogram[bucket] > largest)
+			largest = tracer->histogram[bucket];
+	}
+
+	for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+	{
+		char bar[LATENCY_BAR_WIDTH + 1];
+		int length = (int)((Uint64)tracer->histogram[bucket] * LATENCY_BAR_WIDTH / largest);
+		memset(bar, '#', length);
+		bar[length] = '\0';
+
+		if (bucket == LATENCY_BUCKETS - 1)
+			printf("%3d+    ms %6u %s \n", bucket * LATENCY_BUCKET_MS, tracer->histogram[bucket], bar);
+		else
+			printf("%3d-%-3d ms %6u %s \n", bucket * LATENCY_BUCKET_MS, (bucket + 1) * LATENCY_BUCKET_MS, tracer->histogram[bucket], bar);
+	}
+
+	printf("Given up: %u presses never read, %u read but never drawn \n", tracer->unread, tracer->undrawn);
+}
@@ -0,0 +1,34 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <SDL.h>
+#include "chip8.h"
+
+#define LATENCY_BUCKET_MS 2				// Width of a histogram bucket
+#define LATENCY_BUCKETS 25				// The last bucket holds everything from 48 ms on
+#define LATENCY_TIMEOUT_MS 1000			// A trace that got no further in this long is given up on the next key press
+
+/*
+Times key presses from the SDL event to the presented frame with the first draw the ROM made after it read the key.
+One key press is traced at a time, the presses that come while a trace is running aren't timed.
+*/
+typedef struct {
+	Uint64 frequency;				// Performance counter ticks per second
+	Uint64 press_time;				// Performance counter when the traced key event was handled
+	uint64_t press_cycle;			// Chip8.cycles when the traced key went down
+
+	Uint32 histogram[LATENCY_BUCKETS];
+	Uint32 count;					// Traces that reached a presented frame
+	double total_ms;
+	double max_ms;
+	uint64_t total_read_cycles;		// Instructions from the key going down to the ROM reading it, over all the traces
+	Uint32 unread;					// Traces given up because the ROM never read the key
+	Uint32 undrawn;					// Traces given up because the ROM read the key but never drew
+} LatencyTracer;
+
+void init_tracer(LatencyTracer* tracer);
+void trace_key_press(LatencyTracer* tracer, Chip8* chip, uint8_t key);
+void trace_present(LatencyTracer* tracer, Chip8* chip);
+void print_latency_histogram(LatencyTracer* tracer, const Chip8* chip);
+
+#endif
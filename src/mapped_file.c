@@ -0,0 +1,117 @@
+#include "mapped_file.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+The pages of a mapped file come straight from the page cache, so mapping a ROM costs no buffer and no copy,
+and every instance and thread that maps the same file shares the same physical pages.
+Neither mmap nor MapViewOfFile can map an empty file, an empty file maps to size 0 without a mapping.
+*/
+
+const uint8_t empty_file[1] = { 0 };
+
+int map_file(MappedFile* file, const char* filename)
+{
+	file->data = empty_file;
+	file->size = 0;
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		printf("Could not open file: %s \n", filename);
+		return 1;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size))
+	{
+		printf("Could not read file: %s \n", filename);
+		CloseHandle(handle);
+		return 1;
+	}
+
+	if (size.QuadPart == 0)
+	{
+		CloseHandle(handle);
+		return 0;
+	}
+
+	// The view keeps the mapping and the file open, neither handle is needed after this
+	HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(handle);
+
+	void* view = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (mapping != NULL)
+		CloseHandle(mapping);
+
+	if (view == NULL)
+	{
+		printf("Could not map file: %s \n", filename);
+		return 1;
+	}
+
+	file->data = (const uint8_t*)view;
+	file->size = (size_t)size.QuadPart;
+#else
+	int descriptor = open(filename, O_RDONLY);
+	if (descriptor < 0)
+	{
+		printf("Could not open file: %s \n", filename);
+		return 1;
+	}
+
+	struct stat info;
+	if (fstat(descriptor, &info) != 0)
+	{
+		printf("Could not read file: %s \n", filename);
+		close(descriptor);
+		return 1;
+	}
+
+	if (info.st_size == 0)
+	{
+		close(descriptor);
+		return 0;
+	}
+
+	// The mapping keeps the file open, the descriptor isn't needed after this
+	void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+
+	if (view == MAP_FAILED)
+	{
+		printf("Could not map file: %s \n", filename);
+		return 1;
+	}
+
+	file->data = (const uint8_t*)view;
+	file->size = (size_t)info.st_size;
+#endif
+
+	return 0;
+}
+
+void unmap_file(MappedFile* file)
+{
+	if (file->size > 0)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(file->data);
+#else
+		munmap((void*)file->data, file->size);
+#endif
+	}
+
+	file->data = empty_file;
+	file->size = 0;
+}
@@ -0,0 +1,16 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A whole file mapped read-only into memory, on top of MapViewOfFile or mmap
+typedef struct {
+	const uint8_t* data;			// Shared with every other mapping of the file, never write to it
+	size_t size;
+} MappedFile;
+
+int map_file(MappedFile* file, const char* filename);
+void unmap_file(MappedFile* file);
+
+#endif
@@ -0,0 +1,322 @@
+#include "movie.h"
+#include "savestate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Movie file format, version 4. Every value is little endian.
+
+	 0	"C8MV"
+	 4	uint16 version, uint16 QuirkProfile, movies from before quirk profiles have 0 there
+	 8	uint64 ROM hash
+	16	uint32 seed
+	20	uint32 cycles per frame
+	24	uint32 frames
+	28	uint32 event count
+	32	uint32 checkpoint count
+	36	events, uint32 frame and uint16 keys each
+		checkpoints, uint32 frame and uint64 state hash each
+
+Version 1 to 3 checkpoints hash version 2 to 4 save states, none of them can be compared to the states of this build.
+
+A recording host calls record_movie_keys() before every emulated frame, which only stores the keys when they changed,
+and record_movie_frame() after it. Replaying sets the keys at the same frames and compares the state at every checkpoint.
+*/
+
+#define MOVIE_HEADER_SIZE 36
+#define MOVIE_EVENT_SIZE 6
+#define MOVIE_CHECKPOINT_SIZE 12
+
+// Function prototypes
+int add_checkpoint(Movie* movie, const Chip8* chip);
+
+Movie* create_movie(const Chip8* chip)
+{
+	// Starts recording a chip that was just loaded
+	if (chip->cycles != 0)
+	{
+		printf("Movies have to start at power on \n");
+		return NULL;
+	}
+
+	Movie* movie = (Movie*)calloc(1, sizeof(Movie));
+	if (movie == NULL)
+	{
+		printf("Could not create the movie :(");
+		return NULL;
+	}
+
+	movie->rom_hash = chip->rom_hash;
+	movie->seed = chip->random_state;
+	movie->cycles_per_frame = chip->cycles_per_frame;
+	movie->quirks = chip->quirks;
+	movie->checkpoint_interval = 60;
+
+	return movie;
+}
+
+void destroy_movie(Movie* movie)
+{
+	free(movie->events);
+	free(movie->checkpoints);
+	free(movie);
+}
+
+int record_movie_keys(Movie* movie, const Chip8* chip)
+{
+	uint16_t keys = chip->keys;
+	uint16_t previous = movie->event_count > 0 ? movie->events[movie->event_count - 1].keys : 0;
+	if (keys == previous)
+		return 0;
+
+	if (movie->event_count == movie->event_capacity)
+	{
+		uint32_t capacity = movie->event_capacity > 0 ? movie->event_capacity * 2 : 256;
+		MovieEvent* grown = (MovieEvent*)realloc(movie->events, sizeof(MovieEvent) * capacity);
+		if (grown == NULL)
+			return 1;
+
+		movie->events = grown;
+		movie->event_capacity = capacity;
+	}
+
+	movie->events[movie->event_count].frame = movie->frames;
+	movie->events[movie->event_count].keys = keys;
+	movie->event_count++;
+
+	return 0;
+}
+
+int record_movie_frame(Movie* movie, const Chip8* chip)
+{
+	movie->frames++;
+
+	if (movie->frames % movie->checkpoint_interval == 0)
+		return add_checkpoint(movie, chip);
+
+	return 0;
+}
+
+int add_checkpoint(Movie* movie, const Chip8* chip)
+{
+	if (movie->checkpoint_count == movie->checkpoint_capacity)
+	{
+		uint32_t capacity = movie->checkpoint_capacity > 0 ? movie->checkpoint_capacity * 2 : 64;
+		MovieCheckpoint* grown = (MovieCheckpoint*)realloc(movie->checkpoints, sizeof(MovieCheckpoint) * capacity);
+		if (grown == NULL)
+			return 1;
+
+		movie->checkpoints = grown;
+		movie->checkpoint_capacity = capacity;
+	}
+
+	movie->checkpoints[movie->checkpoint_count].frame = movie->frames;
+	movie->checkpoints[movie->checkpoint_count].state_hash = state_hash(chip);
+	movie->checkpoint_count++;
+
+	return 0;
+}
+
+int save_movie(Movie* movie, const Chip8* chip, const char* filename)
+{
+	// The chip is the one that was recorded, the frame it ended on gets a checkpoint too
+	uint32_t last = movie->checkpoint_count > 0 ? movie->checkpoints[movie->checkpoint_count - 1].frame : 0;
+	if (movie->frames > last && add_checkpoint(movie, chip) != 0)
+		return 1;
+
+	size_t size = MOVIE_HEADER_SIZE + movie->event_count * MOVIE_EVENT_SIZE + movie->checkpoint_count * MOVIE_CHECKPOINT_SIZE;
+	uint8_t* data = (uint8_t*)malloc(size);
+	if (data == NULL)
+		return 1;
+
+	uint8_t* out = data;
+	memcpy(out, "C8MV", 4);
+	out += 4;
+	out = put_state_u16(out, CHIP8_MOVIE_VERSION);
+	out = put_state_u16(out, movie->quirks);
+	out = put_state_u64(out, movie->rom_hash);
+	out = put_state_u32(out, movie->seed);
+	out = put_state_u32(out, movie->cycles_per_frame);
+	out = put_state_u32(out, movie->frames);
+	out = put_state_u32(out, movie->event_count);
+	out = put_state_u32(out, movie->checkpoint_count);
+
+	for (uint32_t i = 0; i < movie->event_count; i++)
+	{
+		out = put_state_u32(out, movie->events[i].frame);
+		out = put_state_u16(out, movie->events[i].keys);
+	}
+
+	for (uint32_t i = 0; i < movie->checkpoint_count; i++)
+	{
+		out = put_state_u32(out, movie->checkpoints[i].frame);
+		out = put_state_u64(out, movie->checkpoints[i].state_hash);
+	}
+
+	FILE* file = fopen(filename, "wb");
+	int status = file == NULL || fwrite(data, 1, size, file) != size;
+	if (file != NULL && fclose(file) != 0)
+		status = 1;
+
+	if (status != 0)
+		printf("Could not write the movie: %s \n", filename);
+
+	free(data);
+	return status;
+}
+
+Movie* load_movie(const char* filename)
+{
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+	{
+		printf("Could not open the movie: %s \n", filename);
+		return NULL;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	rewind(file);
+
+	uint8_t* data = (uint8_t*)malloc(size > 0 ? size : 1);
+	if (data == NULL || fread(data, 1, size, file) != (size_t)size)
+	{
+		printf("Could not read the movie: %s \n", filename);
+		free(data);
+		fclose(file);
+		return NULL;
+	}
+
+	fclose(file);
+
+	const uint8_t* in = data;
+	if (size < MOVIE_HEADER_SIZE || memcmp(in, "C8MV", 4) != 0)
+	{
+		printf("Not a movie: %s \n", filename);
+		free(data);
+		return NULL;
+	}
+	in += 4;
+
+	uint16_t version = get_state_u16(&in);
+	uint16_t quirks = get_state_u16(&in);
+	if (version != CHIP8_MOVIE_VERSION)
+	{
+		printf("Unsupported movie version %u: %s \n", version, filename);
+		free(data);
+		return NULL;
+	}
+
+	if (quirks >= QUIRKS_COUNT)
+	{
+		printf("Unknown quirk profile %u: %s \n", quirks, filename);
+		free(data);
+		return NULL;
+	}
+
+	Movie* movie = (Movie*)calloc(1, sizeof(Movie));
+	if (movie == NULL)
+	{
+		free(data);
+		return NULL;
+	}
+
+	movie->rom_hash = get_state_u64(&in);
+	movie->seed = get_state_u32(&in);
+	movie->cycles_per_frame = get_state_u32(&in);
+	movie->frames = get_state_u32(&in);
+	movie->event_count = get_state_u32(&in);
+	movie->checkpoint_count = get_state_u32(&in);
+	movie->quirks = (uint8_t)quirks;
+	movie->checkpoint_interval = 60;
+
+	uint64_t expected = MOVIE_HEADER_SIZE + (uint64_t)movie->event_count * MOVIE_EVENT_SIZE + (uint64_t)movie->checkpoint_count * MOVIE_CHECKPOINT_SIZE;
+	if ((uint64_t)size != expected)
+	{
+		printf("The movie is truncated: %s \n", filename);
+		destroy_movie(movie);
+		free(data);
+		return NULL;
+	}
+
+	movie->events = (MovieEvent*)malloc(sizeof(MovieEvent) * (movie->event_count > 0 ? movie->event_count : 1));
+	movie->checkpoints = (MovieCheckpoint*)malloc(sizeof(MovieCheckpoint) * (movie->checkpoint_count > 0 ? movie->checkpoint_count : 1));
+	if (movie->events == NULL || movie->checkpoints == NULL)
+	{
+		destroy_movie(movie);
+		free(data);
+		return NULL;
+	}
+
+	movie->event_capacity = movie->event_count;
+	movie->checkpoint_capacity = movie->checkpoint_count;
+
+	for (uint32_t i = 0; i < movie->event_count; i++)
+	{
+		movie->events[i].frame = get_state_u32(&in);
+		movie->events[i].keys = get_state_u16(&in);
+	}
+
+	for (uint32_t i = 0; i < movie->checkpoint_count; i++)
+	{
+		movie->checkpoints[i].frame = get_state_u32(&in);
+		movie->checkpoints[i].state_hash = get_state_u64(&in);
+	}
+
+	free(data);
+	return movie;
+}
+
+int play_movie(const Movie* movie, Chip8* chip, uint32_t* mismatch_frame)
+{
+	/*
+	Replays the movie on a chip that was just loaded, as fast as the host allows.
+	Returns 0 if the state matched at every checkpoint, otherwise 1 and the frame of the first checkpoint that didn't.
+	*/
+	*mismatch_frame = 0;
+
+	if (chip->rom_hash != movie->rom_hash || chip->cycles != 0)
+	{
+		printf("The movie was recorded with a different ROM \n");
+		return 1;
+	}
+
+	seed_chip(chip, movie->seed);
+	set_quirk_profile(chip, (QuirkProfile)movie->quirks);
+	chip->cycles_per_frame = movie->cycles_per_frame;
+
+	uint32_t event = 0;
+	uint32_t checkpoint = 0;
+	for (uint32_t frame = 0; frame < movie->frames; frame++)
+	{
+		for (; event < movie->event_count && movie->events[event].frame == frame; event++)
+			chip->keys = movie->events[event].keys;
+
+		while (emulate_frame(chip) == EXIT_FRAME_DRAWN)
+			;
+
+		if (checkpoint < movie->checkpoint_count && movie->checkpoints[checkpoint].frame == frame + 1)
+		{
+			if (state_hash(chip) != movie->checkpoints[checkpoint].state_hash)
+			{
+				*mismatch_frame = frame + 1;
+				return 1;
+			}
+
+			checkpoint++;
+		}
+	}
+
+	return 0;
+}
+
+uint64_t state_hash(const Chip8* chip)
+{
+	// Hash of everything a save state holds
+	uint8_t state[CHIP8_STATE_MAX_SIZE];
+	size_t size = save_state(chip, state, sizeof(state));
+
+	return hash_bytes(state, size);
+}
@@ -0,0 +1,49 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "chip8.h"
+
+#define CHIP8_MOVIE_VERSION 4
+
+// The keys from frame on, bit N is set when key N is down
+typedef struct MovieEvent {
+	uint32_t frame;
+	uint16_t keys;
+} MovieEvent;
+
+// Hash of the save state after frame frames
+typedef struct MovieCheckpoint {
+	uint32_t frame;
+	uint64_t state_hash;
+} MovieCheckpoint;
+
+/*
+The input of a run from power on, and hashes of its state along the way to check a replay against.
+Replaying it on a chip loaded with the same ROM, in a build with the same core, repeats the run exactly.
+*/
+typedef struct Movie {
+	uint64_t rom_hash;				// Chip8.rom_hash of the ROM it was recorded with
+	uint32_t seed;					// seed_chip() seed
+	uint32_t cycles_per_frame;
+	uint32_t frames;				// Emulated frames recorded
+	uint8_t quirks;					// QuirkProfile
+
+	MovieEvent* events;
+	uint32_t event_count;
+	uint32_t event_capacity;
+	MovieCheckpoint* checkpoints;
+	uint32_t checkpoint_count;
+	uint32_t checkpoint_capacity;
+	uint32_t checkpoint_interval;	// Frames between checkpoints, the last frame always gets one
+} Movie;
+
+Movie* create_movie(const Chip8* chip);
+void destroy_movie(Movie* movie);
+int record_movie_keys(Movie* movie, const Chip8* chip);
+int record_movie_frame(Movie* movie, const Chip8* chip);
+int save_movie(Movie* movie, const Chip8* chip, const char* filename);
+Movie* load_movie(const char* filename);
+int play_movie(const Movie* movie, Chip8* chip, uint32_t* mismatch_frame);
+uint64_t state_hash(const Chip8* chip);
+
+#endif
@@ -0,0 +1,274 @@
+#include "rewind.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Rewind history, one save state for every emulated frame.
+
+Every keyframe_interval frames the whole state is stored, every frame in between only as the XOR of its
+state and the keyframe's. Most of a state doesn't change from one frame to the next, so the XOR is mostly
+zero bytes and both kinds are run-length encoded:
+
+	0x00 - 0x7F		N + 1 zero bytes
+	0x80 - 0xFF		(N & 0x7F) + 1 literal bytes follow
+
+The encoded frames are stored back to back in a ring of bytes. When it's full the oldest keyframe is dropped
+together with every delta against it. Recording and stepping back only use the buffers in the Rewind itself,
+stepping back decodes at most one keyframe and one delta.
+*/
+
+// Function prototypes
+RewindEntry* rewind_entry(Rewind* rewind, uint64_t number);
+uint32_t make_room(Rewind* rewind, uint32_t size);
+void drop_oldest(Rewind* rewind);
+uint32_t encode_frame(const uint8_t* state, const uint8_t* reference, uint32_t size, uint8_t* encoded);
+void decode_frame(const uint8_t* encoded, uint32_t encoded_size, const uint8_t* reference, uint8_t* state, uint32_t size);
+
+Rewind* create_rewind(uint32_t frames, uint32_t capacity)
+{
+	if (frames < 2)
+	{
+		printf("The rewind history needs at least 2 frames \n");
+		return NULL;
+	}
+
+	// The ring has to hold a keyframe and the frame after it, however small a history was asked for
+	if (capacity < 2 * REWIND_ENCODED_MAX_SIZE)
+		capacity = 2 * REWIND_ENCODED_MAX_SIZE;
+
+	Rewind* rewind = (Rewind*)malloc(sizeof(Rewind));
+	if (rewind == NULL)
+	{
+		printf("Could not create the rewind history :(");
+		return NULL;
+	}
+
+	/*
+	A full ring drops the oldest keyframe and up to keyframe_interval - 1 deltas with it, the entries for one
+	more interval keep at least the frames asked for after that
+	*/
+	// A delta is against a keyframe up to an interval old, on a ROM drawing every frame it grows with the interval
+	rewind->keyframe_interval = 15;
+	rewind->data = (uint8_t*)malloc(capacity);
+	rewind->entries = (RewindEntry*)malloc(sizeof(RewindEntry) * (frames + rewind->keyframe_interval));
+	if (rewind->data == NULL || rewind->entries == NULL)
+	{
+		printf("Could not create the rewind history :(");
+		destroy_rewind(rewind);
+		return NULL;
+	}
+
+	rewind->capacity = capacity;
+	rewind->reported_short = 0;
+	rewind->entry_capacity = frames + rewind->keyframe_interval;
+	clear_rewind(rewind);
+
+	return rewind;
+}
+
+void destroy_rewind(Rewind* rewind)
+{
+	free(rewind->data);
+	free(rewind->entries);
+	free(rewind);
+}
+
+void clear_rewind(Rewind* rewind)
+{
+	rewind->first = 0;
+	rewind->count = 0;
+	rewind->keyframe = 0;
+}
+
+void record_frame(Rewind* rewind, const Chip8* chip)
+{
+	// Adds the state of the chip as the newest frame
+	uint32_t size = (uint32_t)save_state(chip, rewind->state, sizeof(rewind->state));
+	uint64_t number = rewind->first + rewind->count;
+
+	// Deltas need a keyframe of the same size, the size changes when memory is written to for the first time
+	uint8_t keyframe = rewind->count == 0
+		|| rewind->keyframe < rewind->first
+		|| number - rewind->keyframe >= rewind->keyframe_interval
+		|| size != rewind_entry(rewind, rewind->keyframe)->state_size;
+
+	uint32_t encoded_size;
+	uint32_t offset;
+	for (;;)
+	{
+		encoded_size = encode_frame(rewind->state, keyframe ? NULL : rewind->key, size, rewind->encoded);
+		offset = make_room(rewind, encoded_size);
+
+		// Making room can drop the keyframe the delta was made against
+		if (keyframe || (rewind->count > 0 && rewind->keyframe >= rewind->first))
+			break;
+
+		keyframe = 1;
+	}
+
+	memcpy(&rewind->data[offset], rewind->encoded, encoded_size);
+
+	RewindEntry* entry = rewind_entry(rewind, number);
+	entry->offset = offset;
+	entry->size = encoded_size;
+	entry->state_size = size;
+	entry->keyframe = keyframe;
+
+	if (rewind->count == 0)
+		rewind->first = number;
+	rewind->count++;
+
+	if (keyframe)
+	{
+		memcpy(rewind->key, rewind->state, size);
+		rewind->keyframe = number;
+	}
+}
+
+int rewind_frame(Rewind* rewind, Chip8* chip)
+{
+	/*
+	Drops the newest frame, which is the state the chip is in, and loads the frame before it.
+	Returns 1 when there is no older frame.
+	*/
+	if (rewind->count < 2)
+		return 1;
+
+	rewind->count--;
+	uint64_t number = rewind->first + rewind->count - 1;
+
+	uint64_t keyframe = number;
+	while (!rewind_entry(rewind, keyframe)->keyframe)
+		keyframe--;
+
+	// Stepping back through the frames of one keyframe only decodes the keyframe once
+	RewindEntry* key_entry = rewind_entry(rewind, keyframe);
+	if (keyframe != rewind->keyframe)
+	{
+		decode_frame(&rewind->data[key_entry->offset], key_entry->size, NULL, rewind->key, key_entry->state_size);
+		rewind->keyframe = keyframe;
+	}
+
+	RewindEntry* entry = rewind_entry(rewind, number);
+	if (entry->keyframe)
+		return load_state(chip, rewind->key, entry->state_size);
+
+	decode_frame(&rewind->data[entry->offset], entry->size, rewind->key, rewind->state, entry->state_size);
+	return load_state(chip, rewind->state, entry->state_size);
+}
+
+RewindEntry* rewind_entry(Rewind* rewind, uint64_t number)
+{
+	return &rewind->entries[number % rewind->entry_capacity];
+}
+
+uint32_t make_room(Rewind* rewind, uint32_t size)
+{
+	// Returns the offset to store size bytes at after dropping the frames in the way
+	if (rewind->count == rewind->entry_capacity)
+		drop_oldest(rewind);
+
+	uint32_t recorded = rewind->count;
+	uint32_t offset = 0;
+	if (rewind->count > 0)
+	{
+		RewindEntry* newest = rewind_entry(rewind, rewind->first + rewind->count - 1);
+		offset = newest->offset + newest->size;
+	}
+
+	// Frames don't wrap around the end of the ring, the bytes left at the end stay unused
+	if (offset + size > rewind->capacity)
+	{
+		while (rewind->count > 0 && rewind_entry(rewind, rewind->first)->offset >= offset)
+			drop_oldest(rewind);
+
+		offset = 0;
+	}
+
+	while (rewind->count > 0)
+	{
+		uint32_t oldest = rewind_entry(rewind, rewind->first)->offset;
+		if (oldest < offset || oldest >= offset + size)
+			break;
+
+		drop_oldest(rewind);
+	}
+
+	// Frames dropped for bytes before the entries ran out make the history shorter than asked for, once is enough
+	if (rewind->count < recorded && recorded < rewind->entry_capacity - rewind->keyframe_interval && !rewind->reported_short)
+	{
+		printf("The rewind history is full after %.1f seconds \n", recorded / 60.0);
+		rewind->reported_short = 1;
+	}
+
+	return offset;
+}
+
+void drop_oldest(Rewind* rewind)
+{
+	// Drops the oldest keyframe and every delta against it
+	do
+	{
+		rewind->first++;
+		rewind->count--;
+	} while (rewind->count > 0 && !rewind_entry(rewind, rewind->first)->keyframe);
+}
+
+uint32_t encode_frame(const uint8_t* state, const uint8_t* reference, uint32_t size, uint8_t* encoded)
+{
+	// Run-length encodes state XOR reference, or state itself when reference is NULL
+#define DIFF(index) (reference != NULL ? state[index] ^ reference[index] : state[index])
+
+	uint32_t out = 0;
+	uint32_t i = 0;
+
+	while (i < size)
+	{
+		uint32_t run = 0;
+		while (i + run < size && run < 128 && DIFF(i + run) == 0)
+			run++;
+
+		if (run > 0)
+		{
+			encoded[out++] = (uint8_t)(run - 1);
+			i += run;
+			continue;
+		}
+
+		// A single zero byte is cheaper as part of the literal than as a run of its own
+		uint32_t token = out++;
+		uint32_t length = 0;
+		while (i < size && length < 128 && !(DIFF(i) == 0 && (i + 1 == size || DIFF(i + 1) == 0)))
+		{
+			encoded[out++] = DIFF(i);
+			i++;
+			length++;
+		}
+
+		encoded[token] = (uint8_t)(0x80 | (length - 1));
+	}
+
+#undef DIFF
+
+	return out;
+}
+
+void decode_frame(const uint8_t* encoded, uint32_t encoded_size, const uint8_t* reference, uint8_t* state, uint32_t size)
+{
+	uint32_t i = 0;
+	uint32_t in = 0;
+
+	while (in < encoded_size && i < size)
+	{
+		uint8_t token = encoded[in++];
+		uint32_t length = (token & 0x7F) + 1;
+
+		for (uint32_t end = i + length; i < end && i < size; i++)
+		{
+			uint8_t value = (token & 0x80) ? encoded[in++] : 0;
+			state[i] = reference != NULL ? value ^ reference[i] : value;
+		}
+	}
+}
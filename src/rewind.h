@@ -0,0 +1,39 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "chip8.h"
+#include "savestate.h"
+
+// A run-length encoded state is at most one token longer for every 128 bytes
+#define REWIND_ENCODED_MAX_SIZE (CHIP8_STATE_MAX_SIZE + CHIP8_STATE_MAX_SIZE / 128 + 1)
+
+typedef struct RewindEntry {
+	uint32_t offset;				// Where the encoded frame starts in the ring
+	uint32_t size;					// Encoded size
+	uint32_t state_size;			// Size of the save state it decodes to
+	uint8_t keyframe;				// 1 for a whole state, 0 for a delta against the keyframe before it
+} RewindEntry;
+
+typedef struct Rewind {
+	uint8_t* data;					// Ring of encoded frames
+	uint32_t capacity;				// Bytes in data
+	RewindEntry* entries;			// Ring of recorded frames, oldest at first
+	uint32_t entry_capacity;
+	uint64_t first;					// Number of the oldest recorded frame, entries[number % entry_capacity]
+	uint32_t count;					// Recorded frames
+	uint32_t keyframe_interval;		// Frames from one keyframe to the next
+	uint8_t reported_short;			// 1 once the bytes ran out before the requested frames did
+
+	uint64_t keyframe;				// Number of the keyframe that key holds
+	uint8_t key[CHIP8_STATE_MAX_SIZE];			// The newest keyframe, decoded
+	uint8_t state[CHIP8_STATE_MAX_SIZE];		// Scratch for the state being recorded or restored
+	uint8_t encoded[REWIND_ENCODED_MAX_SIZE];	// Scratch for the encoded frame
+} Rewind;
+
+Rewind* create_rewind(uint32_t frames, uint32_t capacity);
+void destroy_rewind(Rewind* rewind);
+void record_frame(Rewind* rewind, const Chip8* chip);
+int rewind_frame(Rewind* rewind, Chip8* chip);
+void clear_rewind(Rewind* rewind);
+
+#endif
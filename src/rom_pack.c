@@ -0,0 +1,255 @@
+#include "rom_pack.h"
+#include "savestate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ROM pack format, version 2. Every value is little endian.
+
+	 0	"C8PK"
+	 4	uint16 version, uint16 0
+	 8	uint32 ROM count
+	12	uint32 0
+	16	index, 64 bytes for every ROM in the order they were added
+			 0	uint64 ROM hash, Chip8.rom_hash after loading it
+			 8	uint32 offset of the ROM from the start of the pack
+			12	uint32 size
+			16	uint32 cycles per frame, 0 for the default
+			20	uint32 QuirkProfile
+			24	char name[40], NUL terminated
+		ROMs, each at a multiple of 16 bytes
+
+Version 1 hashes were taken before the SUPER-CHIP font was loaded below the ROM, they don't match any chip now.
+
+The pack is mapped rather than read, opening it only validates the index. The ROMs are loaded
+with load_program() straight from the mapping, every chip that loads a ROM shares the same pages.
+*/
+
+#define ROM_PACK_HEADER_SIZE 16
+#define ROM_PACK_ENTRY_SIZE 64
+#define ROM_PACK_ALIGNMENT 16
+
+// Function prototypes
+const char* base_name(const char* path);
+
+RomPack* open_rom_pack(const char* filename)
+{
+	RomPack* pack = (RomPack*)calloc(1, sizeof(RomPack));
+	if (pack == NULL)
+	{
+		printf("Could not open the ROM pack :(");
+		return NULL;
+	}
+
+	if (map_file(&pack->file, filename) != 0)
+	{
+		free(pack);
+		return NULL;
+	}
+
+	const uint8_t* in = pack->file.data;
+	size_t size = pack->file.size;
+	if (size < ROM_PACK_HEADER_SIZE || memcmp(in, "C8PK", 4) != 0)
+	{
+		printf("Not a ROM pack: %s \n", filename);
+		close_rom_pack(pack);
+		return NULL;
+	}
+	in += 4;
+
+	uint16_t version = get_state_u16(&in);
+	get_state_u16(&in);
+	if (version != CHIP8_PACK_VERSION)
+	{
+		printf("Unsupported ROM pack version %u: %s \n", version, filename);
+		close_rom_pack(pack);
+		return NULL;
+	}
+
+	uint32_t count = get_state_u32(&in);
+	get_state_u32(&in);
+	if (ROM_PACK_HEADER_SIZE + (uint64_t)count * ROM_PACK_ENTRY_SIZE > size)
+	{
+		printf("The ROM pack is truncated: %s \n", filename);
+		close_rom_pack(pack);
+		return NULL;
+	}
+
+	pack->roms = (PackedRom*)malloc(sizeof(PackedRom) * (count > 0 ? count : 1));
+	if (pack->roms == NULL)
+	{
+		close_rom_pack(pack);
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint8_t* entry = in + i * ROM_PACK_ENTRY_SIZE;
+		const uint8_t* field = entry;
+		PackedRom* rom = &pack->roms[i];
+
+		rom->rom_hash = get_state_u64(&field);
+		uint32_t offset = get_state_u32(&field);
+		rom->size = get_state_u32(&field);
+		rom->cycles_per_frame = get_state_u32(&field);
+		uint32_t quirks = get_state_u32(&field);
+		rom->quirks = (uint8_t)quirks;
+		rom->name = (const char*)entry + 24;
+		rom->data = pack->file.data + offset;
+
+		if ((uint64_t)offset + rom->size > size || rom->size > CHIP8_MEMORY_SIZE - 512 || quirks >= QUIRKS_COUNT || memchr(rom->name, 0, ROM_PACK_NAME_LENGTH + 1) == NULL)
+		{
+			printf("ROM %u of the pack is broken: %s \n", i, filename);
+			close_rom_pack(pack);
+			return NULL;
+		}
+	}
+
+	pack->rom_count = count;
+	return pack;
+}
+
+void close_rom_pack(RomPack* pack)
+{
+	unmap_file(&pack->file);
+	free(pack->roms);
+	free(pack);
+}
+
+const PackedRom* find_packed_rom(const RomPack* pack, const char* name)
+{
+	for (uint32_t i = 0; i < pack->rom_count; i++)
+	{
+		if (strcmp(pack->roms[i].name, name) == 0)
+			return &pack->roms[i];
+	}
+
+	return NULL;
+}
+
+const PackedRom* find_packed_rom_hash(const RomPack* pack, uint64_t rom_hash)
+{
+	for (uint32_t i = 0; i < pack->rom_count; i++)
+	{
+		if (pack->roms[i].rom_hash == rom_hash)
+			return &pack->roms[i];
+	}
+
+	return NULL;
+}
+
+int build_rom_pack(const char* filename, char** rom_names, int rom_count, uint32_t cycles_per_frame, QuirkProfile quirks)
+{
+	/*
+	Writes every ROM file to a new pack under its file name without the directory.
+	Every ROM is loaded into a chip once to check it and to get its hash.
+	*/
+	MappedFile* files = (MappedFile*)calloc(rom_count > 0 ? rom_count : 1, sizeof(MappedFile));
+	uint64_t* hashes = (uint64_t*)malloc(sizeof(uint64_t) * (rom_count > 0 ? rom_count : 1));
+	int mapped = 0;
+	int failed = files == NULL || hashes == NULL;
+
+	size_t size = ROM_PACK_HEADER_SIZE + (size_t)rom_count * ROM_PACK_ENTRY_SIZE;
+	for (; mapped < rom_count && !failed; mapped++)
+	{
+		const char* name = base_name(rom_names[mapped]);
+		if (strlen(name) > ROM_PACK_NAME_LENGTH)
+		{
+			printf("ROM names in a pack can be at most %d characters long: %s \n", ROM_PACK_NAME_LENGTH, name);
+			failed = 1;
+			break;
+		}
+
+		for (int other = 0; other < mapped; other++)
+		{
+			if (strcmp(base_name(rom_names[other]), name) == 0)
+			{
+				printf("The pack already has a ROM called %s \n", name);
+				failed = 1;
+			}
+		}
+
+		if (failed || map_file(&files[mapped], rom_names[mapped]) != 0)
+		{
+			failed = 1;
+			break;
+		}
+
+		// A fresh chip every time, the hash covers memory past the ROM and a shorter ROM doesn't overwrite all of the last one
+		Chip8* probe = create_chip();
+		if (probe == NULL || load_program(probe, files[mapped].data, files[mapped].size) != 0)
+		{
+			if (probe != NULL)
+				destroy_chip(probe);
+			mapped++;
+			failed = 1;
+			break;
+		}
+
+		hashes[mapped] = probe->rom_hash;
+		destroy_chip(probe);
+		size = (size + ROM_PACK_ALIGNMENT - 1) / ROM_PACK_ALIGNMENT * ROM_PACK_ALIGNMENT + files[mapped].size;
+	}
+
+	uint8_t* data = !failed ? (uint8_t*)calloc(1, size) : NULL;
+	if (!failed && data == NULL)
+		failed = 1;
+
+	if (!failed)
+	{
+		uint8_t* out = data;
+		memcpy(out, "C8PK", 4);
+		out += 4;
+		out = put_state_u16(out, CHIP8_PACK_VERSION);
+		out = put_state_u16(out, 0);
+		out = put_state_u32(out, (uint32_t)rom_count);
+		out = put_state_u32(out, 0);
+
+		size_t offset = ROM_PACK_HEADER_SIZE + (size_t)rom_count * ROM_PACK_ENTRY_SIZE;
+		for (int i = 0; i < rom_count; i++)
+		{
+			offset = (offset + ROM_PACK_ALIGNMENT - 1) / ROM_PACK_ALIGNMENT * ROM_PACK_ALIGNMENT;
+			memcpy(&data[offset], files[i].data, files[i].size);
+
+			uint8_t* entry = out + i * ROM_PACK_ENTRY_SIZE;
+			entry = put_state_u64(entry, hashes[i]);
+			entry = put_state_u32(entry, (uint32_t)offset);
+			entry = put_state_u32(entry, (uint32_t)files[i].size);
+			entry = put_state_u32(entry, cycles_per_frame);
+			entry = put_state_u32(entry, (uint32_t)quirks);
+			strcpy((char*)entry, base_name(rom_names[i]));
+
+			offset += files[i].size;
+		}
+
+		FILE* file = fopen(filename, "wb");
+		failed = file == NULL || fwrite(data, 1, size, file) != size;
+		if (file != NULL && fclose(file) != 0)
+			failed = 1;
+
+		if (failed)
+			printf("Could not write the ROM pack: %s \n", filename);
+	}
+
+	for (int i = 0; i < mapped; i++)
+		unmap_file(&files[i]);
+
+	free(data);
+	free(files);
+	free(hashes);
+	return failed;
+}
+
+const char* base_name(const char* path)
+{
+	const char* name = path;
+	for (const char* c = path; *c != 0; c++)
+	{
+		if (*c == '/' || *c == '\\')
+			name = c + 1;
+	}
+
+	return name;
+}
@@ -0,0 +1,35 @@
+#ifndef ROM_PACK_H
+#define ROM_PACK_H
+
+#include "chip8.h"
+#include "mapped_file.h"
+
+#define CHIP8_PACK_VERSION 2
+
+// Longest ROM name a pack can hold, not counting the terminating NUL
+#define ROM_PACK_NAME_LENGTH 39
+
+// One ROM in a pack, name and data point into the mapped pack
+typedef struct {
+	const char* name;
+	const uint8_t* data;
+	uint32_t size;
+	uint64_t rom_hash;				// Chip8.rom_hash after loading it
+	uint32_t cycles_per_frame;		// 0 for the default
+	uint8_t quirks;					// QuirkProfile to run it with
+} PackedRom;
+
+// Many ROMs in one file that is mapped once, the ROMs are shared read-only by every chip and thread that loads them
+typedef struct {
+	MappedFile file;
+	PackedRom* roms;
+	uint32_t rom_count;
+} RomPack;
+
+RomPack* open_rom_pack(const char* filename);
+void close_rom_pack(RomPack* pack);
+const PackedRom* find_packed_rom(const RomPack* pack, const char* name);
+const PackedRom* find_packed_rom_hash(const RomPack* pack, uint64_t rom_hash);
+int build_rom_pack(const char* filename, char** rom_names, int rom_count, uint32_t cycles_per_frame, QuirkProfile quirks);
+
+#endif
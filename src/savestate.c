@@ -0,0 +1,279 @@
+#include "savestate.h"
+#include "chip8_jit.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+Save state format, version 5. Every value is little endian.
+
+	 0	"C8ST"
+	 4	uint16 version
+	 6	uint16 keys, bit N is set when key N is down
+	 8	uint64 hash of memory as load_program() left it, a state only loads into a chip running the same ROM
+	16	uint64 dirty pages[16], bit N of word W is set when the 64 bytes at (W * 64 + N) * 64 are stored at the end
+	144	uint64 cycles
+	152	uint32 cycles per frame
+	156	uint32 frame cycles
+	160	uint32 random state
+	164	uint16 program counter, I, stack pointer
+	170	uint16 stack[16]
+	202	uint8 V[16]
+	218	uint8 delay timer, sound timer
+	220	uint8 flags[16], FX75 and FX85
+	236	uint8 audio pattern[16]
+	252	uint16 pitch
+	254	uint16 1 in the 128x64 mode, 0 in the 64x32 mode
+	256	uint16 selected planes
+	258	uint64 display planes[2][64][2], leftmost pixel in the most significant bit of the first word of a row
+	2306	64 bytes for every dirty page, lowest page first
+
+Version 1 had no random state, CXNN still used rand() then. Version 2 only had the 64x32 display, 32 rows of one word.
+Version 3 had 4 KB of memory, one word of dirty pages and a single plane. Version 4 had no audio pattern and pitch.
+
+Memory that was never written to is not stored, it is restored from the image load_program() left.
+Neither function allocates, save_state() writes into the caller's buffer and load_state() only touches the chip.
+*/
+
+// Function prototypes
+size_t count_pages(const uint64_t* pages);
+uint8_t restore_page(Chip8* chip, int page, const uint8_t* contents);
+
+size_t state_size(const Chip8* chip)
+{
+	return CHIP8_STATE_FIXED_SIZE + count_pages(chip->dirty_pages) * CHIP8_PAGE_SIZE;
+}
+
+size_t save_state(const Chip8* chip, uint8_t* buffer, size_t capacity)
+{
+	// Returns the number of bytes written, or 0 if the state doesn't fit in capacity bytes
+	size_t size = state_size(chip);
+	if (capacity < size)
+		return 0;
+
+	uint8_t* out = buffer;
+	memcpy(out, "C8ST", 4);
+	out += 4;
+	out = put_state_u16(out, CHIP8_STATE_VERSION);
+
+	out = put_state_u16(out, chip->keys);
+
+	out = put_state_u64(out, chip->rom_hash);
+
+	for (int i = 0; i < CHIP8_PAGES / 64; i++)
+		out = put_state_u64(out, chip->dirty_pages[i]);
+
+	out = put_state_u64(out, chip->cycles);
+	out = put_state_u32(out, chip->cycles_per_frame);
+	out = put_state_u32(out, chip->frame_cycles);
+	out = put_state_u32(out, chip->random_state);
+	out = put_state_u16(out, chip->program_counter);
+	out = put_state_u16(out, chip->I);
+	out = put_state_u16(out, chip->stack_pointer);
+
+	for (int i = 0; i < 16; i++)
+		out = put_state_u16(out, chip->stack[i]);
+
+	memcpy(out, chip->V, 16);
+	out += 16;
+	*out++ = chip->delay_timer;
+	*out++ = chip->sound_timer;
+	memcpy(out, chip->flags, 16);
+	out += 16;
+	memcpy(out, chip->audio_pattern, 16);
+	out += 16;
+	out = put_state_u16(out, chip->pitch);
+	out = put_state_u16(out, chip->display_buffer.hires);
+	out = put_state_u16(out, chip->display_buffer.plane_mask);
+
+	for (int plane = 0; plane < CHIP8_PLANES; plane++)
+	{
+		for (int y = 0; y < 64; y++)
+		{
+			out = put_state_u64(out, chip->display_buffer.planes[plane][y][0]);
+			out = put_state_u64(out, chip->display_buffer.planes[plane][y][1]);
+		}
+	}
+
+	for (int page = 0; page < CHIP8_PAGES; page++)
+	{
+		if ((chip->dirty_pages[page / 64] >> (page % 64)) & 1)
+		{
+			memcpy(out, &chip->memory[page * CHIP8_PAGE_SIZE], CHIP8_PAGE_SIZE);
+			out += CHIP8_PAGE_SIZE;
+		}
+	}
+
+	return size;
+}
+
+int load_state(Chip8* chip, const uint8_t* buffer, size_t size)
+{
+	// The chip is only changed when the whole state is valid
+	const uint8_t* in = buffer;
+
+	if (size < CHIP8_STATE_FIXED_SIZE || memcmp(in, "C8ST", 4) != 0)
+	{
+		printf("Not a save state \n");
+		return 1;
+	}
+	in += 4;
+
+	uint16_t version = get_state_u16(&in);
+	if (version != CHIP8_STATE_VERSION)
+	{
+		printf("Unsupported save state version: %u \n", version);
+		return 1;
+	}
+
+	uint16_t keys = get_state_u16(&in);
+	uint64_t rom_hash = get_state_u64(&in);
+	uint64_t dirty_pages[CHIP8_PAGES / 64];
+
+	for (int i = 0; i < CHIP8_PAGES / 64; i++)
+		dirty_pages[i] = get_state_u64(&in);
+
+	if (rom_hash != chip->rom_hash)
+	{
+		printf("The save state is for a different ROM \n");
+		return 1;
+	}
+
+	if (size != CHIP8_STATE_FIXED_SIZE + count_pages(dirty_pages) * CHIP8_PAGE_SIZE)
+	{
+		printf("The save state is truncated \n");
+		return 1;
+	}
+
+	// Values the chip can't hold would send later instructions out of bounds, see the offsets above
+	const uint8_t* field = buffer + 168;
+	uint16_t stack_pointer = get_state_u16(&field);
+	field = buffer + 252;
+	uint16_t pitch = get_state_u16(&field);
+	uint16_t hires = get_state_u16(&field);
+	uint16_t plane_mask = get_state_u16(&field);
+
+	if (stack_pointer > 16 || pitch > 0xFF || hires > 1 || plane_mask >= 1 << CHIP8_PLANES)
+	{
+		printf("The save state is corrupt \n");
+		return 1;
+	}
+
+	chip->keys = keys;
+
+	chip->cycles = get_state_u64(&in);
+	chip->cycles_per_frame = get_state_u32(&in);
+	chip->frame_cycles = get_state_u32(&in);
+	chip->random_state = seed_random(get_state_u32(&in));
+	chip->program_counter = get_state_u16(&in);
+	chip->I = get_state_u16(&in);
+	chip->stack_pointer = get_state_u16(&in);
+
+	for (int i = 0; i < 16; i++)
+		chip->stack[i] = get_state_u16(&in);
+
+	memcpy(chip->V, in, 16);
+	in += 16;
+	chip->delay_timer = *in++;
+	chip->sound_timer = *in++;
+	memcpy(chip->flags, in, 16);
+	in += 16;
+	memcpy(chip->audio_pattern, in, 16);
+	in += 16;
+	chip->pitch = (uint8_t)get_state_u16(&in);
+	chip->display_buffer.hires = get_state_u16(&in) != 0;
+	chip->display_buffer.plane_mask = get_state_u16(&in) & ((1 << CHIP8_PLANES) - 1);
+
+	for (int plane = 0; plane < CHIP8_PLANES; plane++)
+	{
+		for (int y = 0; y < 64; y++)
+		{
+			chip->display_buffer.planes[plane][y][0] = get_state_u64(&in);
+			chip->display_buffer.planes[plane][y][1] = get_state_u64(&in);
+		}
+	}
+
+	// Only pages that are dirty in the chip or in the state can differ from the loaded image
+	uint8_t code_changed = 0;
+	for (int page = 0; page < CHIP8_PAGES; page++)
+	{
+		if ((dirty_pages[page / 64] >> (page % 64)) & 1)
+		{
+			code_changed |= restore_page(chip, page, in);
+			in += CHIP8_PAGE_SIZE;
+		}
+		else if ((chip->dirty_pages[page / 64] >> (page % 64)) & 1)
+			code_changed |= restore_page(chip, page, &chip->loaded_memory[page * CHIP8_PAGE_SIZE]);
+	}
+
+	if (code_changed && chip->jit != NULL)
+		jit_flush(chip);
+
+	memcpy(chip->dirty_pages, dirty_pages, sizeof(chip->dirty_pages));
+	chip->redraw = 1;
+
+	return 0;
+}
+
+uint8_t restore_page(Chip8* chip, int page, const uint8_t* contents)
+{
+	// Returns 1 if the page changed, the instructions decoded from it are dropped then
+	uint8_t* memory = &chip->memory[page * CHIP8_PAGE_SIZE];
+	if (memcmp(memory, contents, CHIP8_PAGE_SIZE) == 0)
+		return 0;
+
+	memcpy(memory, contents, CHIP8_PAGE_SIZE);
+	drop_decoded(chip, (uint16_t)(page * CHIP8_PAGE_SIZE), CHIP8_PAGE_SIZE);
+
+	return 1;
+}
+
+size_t count_pages(const uint64_t* pages)
+{
+	size_t count = 0;
+	for (int i = 0; i < CHIP8_PAGES / 64; i++)
+	{
+		for (uint64_t word = pages[i]; word != 0; word &= word - 1)
+			count++;
+	}
+
+	return count;
+}
+
+uint8_t* put_state_u16(uint8_t* out, uint16_t value)
+{
+	out[0] = (uint8_t)value;
+	out[1] = (uint8_t)(value >> 8);
+	return out + 2;
+}
+
+uint8_t* put_state_u32(uint8_t* out, uint32_t value)
+{
+	out = put_state_u16(out, (uint16_t)value);
+	return put_state_u16(out, (uint16_t)(value >> 16));
+}
+
+uint8_t* put_state_u64(uint8_t* out, uint64_t value)
+{
+	out = put_state_u32(out, (uint32_t)value);
+	return put_state_u32(out, (uint32_t)(value >> 32));
+}
+
+uint16_t get_state_u16(const uint8_t** in)
+{
+	uint16_t value = (*in)[0] | (*in)[1] << 8;
+	*in += 2;
+	return value;
+}
+
+uint32_t get_state_u32(const uint8_t** in)
+{
+	uint32_t low = get_state_u16(in);
+	return low | (uint32_t)get_state_u16(in) << 16;
+}
+
+uint64_t get_state_u64(const uint8_t** in)
+{
+	uint64_t low = get_state_u32(in);
+	return low | (uint64_t)get_state_u32(in) << 32;
+}
@@ -0,0 +1,24 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include "chip8.h"
+
+#define CHIP8_STATE_VERSION 5
+
+// Everything but memory takes 2306 bytes, the pages of memory that were written to add 64 bytes each
+#define CHIP8_STATE_FIXED_SIZE 2306
+#define CHIP8_STATE_MAX_SIZE (CHIP8_STATE_FIXED_SIZE + CHIP8_MEMORY_SIZE)
+
+size_t save_state(const Chip8* chip, uint8_t* buffer, size_t capacity);
+int load_state(Chip8* chip, const uint8_t* buffer, size_t size);
+size_t state_size(const Chip8* chip);
+
+// Little endian stores and loads, the put functions return the position after the value
+uint8_t* put_state_u16(uint8_t* out, uint16_t value);
+uint8_t* put_state_u32(uint8_t* out, uint32_t value);
+uint8_t* put_state_u64(uint8_t* out, uint64_t value);
+uint16_t get_state_u16(const uint8_t** in);
+uint32_t get_state_u32(const uint8_t** in);
+uint64_t get_state_u64(const uint8_t** in);
+
+#endif